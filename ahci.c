@@ -0,0 +1,537 @@
+#include "ahci.h"
+#include "pci.h"
+#include "idt.h"
+#include "io.h"
+#include "lib.h"
+#include "mm.h"
+#include "screen.h"
+
+// Estado del controlador
+static volatile struct ahci_hba_regs *ahci_hba = NULL;
+static struct ahci_port *ahci_ports[AHCI_MAX_PORTS];
+static int ahci_port_count = 0;
+static u8 ahci_hba_ncq = 0;
+static u8 ahci_hba_slots = 1;
+
+// Espera completada de un comando síncrono
+struct ahci_wait {
+    volatile int done;
+    int status;
+};
+
+// Indica si las interrupciones están habilitadas (EFLAGS.IF)
+static int ahci_irqs_enabled(void) {
+    u32 flags;
+
+    asm volatile("pushfl; popl %0" : "=r" (flags));
+    return (flags & 0x200) != 0;
+}
+
+// Detener el motor de comandos y la recepción de FIS
+static int ahci_port_stop(volatile struct ahci_port_regs *regs) {
+    int timeout = AHCI_TIMEOUT;
+
+    regs->cmd &= ~AHCI_PxCMD_ST;
+    while ((regs->cmd & AHCI_PxCMD_CR) && --timeout);
+
+    regs->cmd &= ~AHCI_PxCMD_FRE;
+    while ((regs->cmd & AHCI_PxCMD_FR) && --timeout);
+
+    return timeout ? 0 : -1;
+}
+
+// Arrancar el puerto cuando el dispositivo ya no está ocupado
+static int ahci_port_start(volatile struct ahci_port_regs *regs) {
+    int timeout = AHCI_TIMEOUT;
+
+    regs->cmd |= AHCI_PxCMD_FRE;
+    while ((regs->tfd & (AHCI_TFD_BSY | AHCI_TFD_DRQ)) && --timeout);
+    if (!timeout) return -1;
+
+    regs->cmd |= AHCI_PxCMD_ST;
+    return 0;
+}
+
+/*
+ * Preparar la tabla de comando de un slot: FIS H2D y entradas PRDT.
+ * Cada entrada PRDT cubre como mucho 4MB de un segmento contiguo.
+ */
+static int ahci_build_cmd(struct ahci_port *port, int slot, u8 command,
+                          u32 lba, u32 count, struct blk_seg *sg, int nsg,
+                          int write) {
+    struct ahci_cmd_header *hdr = &port->clist[slot];
+    struct ahci_cmd_table *tbl = &port->tables[slot];
+    struct fis_reg_h2d *fis = (struct fis_reg_h2d *)tbl->cfis;
+    int n = 0;
+    int i;
+
+    memset(tbl, 0, sizeof(struct ahci_cmd_table));
+
+    for (i = 0; i < nsg; i++) {
+        u32 addr = (u32)sg[i].buf;
+        u32 left = sg[i].count * 512;
+
+        while (left > 0) {
+            u32 chunk = (left < AHCI_PRD_MAX_BYTES) ? left : AHCI_PRD_MAX_BYTES;
+
+            if (n >= AHCI_PRDT_ENTRIES) return -1;
+
+            tbl->prdt[n].dba = addr;
+            tbl->prdt[n].dbau = 0;
+            tbl->prdt[n].dbc = chunk - 1;
+
+            addr += chunk;
+            left -= chunk;
+            n++;
+        }
+    }
+
+    fis->type = FIS_TYPE_REG_H2D;
+    fis->flags = 0x80;
+    fis->command = command;
+    fis->device = 0x40;     // modo LBA
+    fis->lba0 = lba & 0xFF;
+    fis->lba1 = (lba >> 8) & 0xFF;
+    fis->lba2 = (lba >> 16) & 0xFF;
+    fis->lba3 = (lba >> 24) & 0xFF;
+
+    if (command == ATA_CMD_READ_FPDMA_QUEUED || command == ATA_CMD_WRITE_FPDMA_QUEUED) {
+        // NCQ: el número de sectores va en FEATURES y el tag en COUNT
+        fis->featurel = count & 0xFF;
+        fis->featureh = (count >> 8) & 0xFF;
+        fis->countl = slot << 3;
+    } else {
+        fis->countl = count & 0xFF;
+        fis->counth = (count >> 8) & 0xFF;
+    }
+
+    hdr->flags = (sizeof(struct fis_reg_h2d) / 4) | (write ? AHCI_CMD_WRITE : 0);
+    hdr->prdtl = n;
+    hdr->prdbc = 0;
+
+    return 0;
+}
+
+// Reservar un slot libre dentro de la profundidad de cola del puerto
+static int ahci_alloc_slot(struct ahci_port *port) {
+    u32 flags;
+    int i;
+
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags));
+    for (i = 0; i < port->depth; i++) {
+        if (!(port->busy & (1 << i))) {
+            port->busy |= (1 << i);
+            asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+            return i;
+        }
+    }
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+    return -1;
+}
+
+/*
+ * Enviar un comando de lectura/escritura sin esperar a que termine.
+ * Con NCQ pueden quedar hasta 32 comandos en vuelo por puerto; 'done'
+ * se llama desde la interrupción con 0 o -1. Devuelve -1 si no hay slot.
+ */
+int ahci_submit(struct ahci_port *port, u32 lba, u32 count,
+                struct blk_seg *sg, int nsg, int write,
+                void (*done)(void *arg, int status), void *arg) {
+    u8 command;
+    int slot;
+
+    if (count == 0 || count > AHCI_MAX_COUNT) return -1;
+
+    slot = ahci_alloc_slot(port);
+    if (slot < 0) return -1;
+
+    if (port->ncq) {
+        command = write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+    } else {
+        command = write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    }
+
+    if (ahci_build_cmd(port, slot, command, lba, count, sg, nsg, write)) {
+        port->busy &= ~(1 << slot);
+        return -1;
+    }
+
+    port->slots[slot].done = done;
+    port->slots[slot].arg = arg;
+
+    // En NCQ el slot se marca en PxSACT antes de emitirlo en PxCI
+    if (port->ncq) {
+        port->regs->sact = 1 << slot;
+    }
+    port->regs->ci = 1 << slot;
+
+    return 0;
+}
+
+/*
+ * Recoger los comandos terminados de un puerto. Un slot terminó cuando
+ * desaparece de PxCI (y de PxSACT en NCQ). Ante un error del task file
+ * se fallan todos los comandos en vuelo y se reinicia el motor.
+ */
+static void ahci_port_complete(struct ahci_port *port) {
+    volatile struct ahci_port_regs *regs = port->regs;
+    u32 is = regs->is;
+    u32 finished;
+    int status = 0;
+    int i;
+
+    regs->is = is;
+
+    if (is & AHCI_PxIS_TFES) {
+        print("AHCI   : task file error on port ");
+        print_dec(port->index);
+        print("\n");
+
+        finished = port->busy;
+        status = -1;
+
+        ahci_port_stop(regs);
+        regs->serr = 0xFFFFFFFF;
+        regs->is = 0xFFFFFFFF;
+        ahci_port_start(regs);
+    } else {
+        finished = port->busy & ~(regs->ci | regs->sact);
+    }
+
+    for (i = 0; i < AHCI_MAX_SLOTS && finished; i++) {
+        if (finished & (1 << i)) {
+            void (*done)(void *, int) = port->slots[i].done;
+            void *arg = port->slots[i].arg;
+
+            finished &= ~(1 << i);
+            port->busy &= ~(1 << i);
+            if (done) done(arg, status);
+        }
+    }
+}
+
+// Manejador de la IRQ del HBA (puede estar compartida con otros PCI)
+void isr_ahci_int(void) {
+    u32 pending;
+    int i;
+
+    if (ahci_hba == NULL) return;
+
+    pending = ahci_hba->is;
+    if (!pending) return;
+
+    for (i = 0; i < ahci_port_count; i++) {
+        if (pending & (1 << ahci_ports[i]->index)) {
+            ahci_port_complete(ahci_ports[i]);
+        }
+    }
+
+    ahci_hba->is = pending;
+}
+
+static void ahci_sync_done(void *arg, int status) {
+    struct ahci_wait *w = (struct ahci_wait *)arg;
+
+    w->status = status;
+    w->done = 1;
+}
+
+/*
+ * Esperar un comando síncrono. Con interrupciones se duerme con hlt; en
+ * cada despertar (o en bucle, durante el arranque) se revisa el puerto
+ * por si la IRQ no llega.
+ */
+static void ahci_wait_done(struct ahci_port *port, struct ahci_wait *w) {
+    int irqs = ahci_irqs_enabled();
+
+    cli;
+    while (!w->done) {
+        ahci_port_complete(port);
+        if (w->done) break;
+        if (irqs) asm volatile("sti; hlt; cli");
+    }
+    if (irqs) sti;
+}
+
+// Emitir un comando y esperar a que termine; reintenta si no hay slot libre
+static int ahci_rw_one(struct ahci_port *port, u32 lba, u32 count, void *buf, int write) {
+    struct ahci_wait w;
+    struct blk_seg sg;
+
+    sg.buf = buf;
+    sg.count = count;
+    w.done = 0;
+    w.status = 0;
+
+    while (ahci_submit(port, lba, count, &sg, 1, write, ahci_sync_done, &w)) {
+        int irqs = ahci_irqs_enabled();
+
+        if (port->busy == 0) return -1;    // el comando no es válido
+        cli;
+        ahci_port_complete(port);
+        if (irqs) sti;
+    }
+
+    ahci_wait_done(port, &w);
+    return w.status;
+}
+
+/*
+ * Lectura/escritura síncrona de cualquier tamaño. Los buffers en
+ * direcciones impares (el DMA exige alineación a palabra) pasan por el
+ * buffer intermedio del puerto.
+ */
+static int ahci_rw(struct ahci_port *port, u32 lba, u32 count, void *buffer, int write) {
+    u8 *buf = (u8 *)buffer;
+    u32 max = ((u32)buf & 1) ? AHCI_BOUNCE_SECTORS : AHCI_MAX_COUNT;
+    u32 n;
+
+    while (count > 0) {
+        n = (count < max) ? count : max;
+
+        if ((u32)buf & 1) {
+            if (write) memcpy(port->bounce, buf, n * 512);
+            if (ahci_rw_one(port, lba, n, port->bounce, write)) return -1;
+            if (!write) memcpy(buf, port->bounce, n * 512);
+        } else if (ahci_rw_one(port, lba, n, buf, write)) {
+            return -1;
+        }
+
+        lba += n;
+        buf += n * 512;
+        count -= n;
+    }
+
+    return 0;
+}
+
+static void ahci_blk_done(void *arg, int status) {
+    blockdev_complete((struct blk_request *)arg, status);
+}
+
+/*
+ * Operación submit de la cola de bloques. Con segmentos en direcciones
+ * impares se usa la ruta síncrona con buffer intermedio.
+ */
+static int ahci_blk_submit(struct blockdev *dev, struct blk_request *rq) {
+    struct ahci_port *port = (struct ahci_port *)dev->priv;
+    u32 lba = rq->lba;
+    int status = 0;
+    int i;
+
+    for (i = 0; i < rq->nseg; i++) {
+        if ((u32)rq->segs[i].buf & 1) break;
+    }
+
+    if (i == rq->nseg) {
+        if (ahci_submit(port, rq->lba, rq->count, rq->segs, rq->nseg, rq->write,
+                        ahci_blk_done, rq) == 0) {
+            return BLK_OK;
+        }
+        // Todos los slots ocupados: la cola reintenta al completar uno
+        return port->busy ? BLK_BUSY : -1;
+    }
+
+    for (i = 0; i < rq->nseg && status == 0; i++) {
+        status = ahci_rw(port, lba, rq->segs[i].count, rq->segs[i].buf, rq->write);
+        lba += rq->segs[i].count;
+    }
+    blockdev_complete(rq, status);
+    return BLK_OK;
+}
+
+// Operación poll: recoger completados sin depender de la IRQ
+static void ahci_blk_poll(struct blockdev *dev) {
+    ahci_port_complete((struct ahci_port *)dev->priv);
+}
+
+// IDENTIFY DEVICE por el slot 0, con polling (se llama durante el arranque)
+static int ahci_identify(struct ahci_port *port, u16 *ident) {
+    struct blk_seg sg;
+    int timeout = AHCI_TIMEOUT;
+
+    sg.buf = ident;
+    sg.count = 1;
+
+    port->busy |= 1;
+    if (ahci_build_cmd(port, 0, ATA_CMD_IDENTIFY, 0, 0, &sg, 1, 0)) {
+        port->busy = 0;
+        return -1;
+    }
+    port->clist[0].flags &= ~AHCI_CMD_WRITE;
+
+    port->regs->ci = 1;
+    while ((port->regs->ci & 1) && !(port->regs->is & AHCI_PxIS_TFES) && --timeout);
+
+    port->busy = 0;
+    port->regs->is = port->regs->is;
+
+    if (!timeout || (port->regs->tfd & AHCI_TFD_ERR)) return -1;
+    return 0;
+}
+
+// Preparar las estructuras de un puerto con un disco SATA
+static struct ahci_port *ahci_port_init(int index) {
+    volatile struct ahci_port_regs *regs = &ahci_hba->ports[index];
+    struct ahci_port *port;
+    u16 *ident;
+    int i;
+
+    port = (struct ahci_port *)kmalloc(sizeof(struct ahci_port));
+    ident = (u16 *)kmalloc_aligned(512, 4);
+    if (port == NULL || ident == NULL) return NULL;
+
+    memset(port, 0, sizeof(struct ahci_port));
+    port->regs = regs;
+    port->index = index;
+    port->clist = (struct ahci_cmd_header *)kmalloc_aligned(
+        AHCI_MAX_SLOTS * sizeof(struct ahci_cmd_header), 1024);
+    port->fis = (u8 *)kmalloc_aligned(256, 256);
+    port->tables = (struct ahci_cmd_table *)kmalloc_aligned(
+        AHCI_MAX_SLOTS * sizeof(struct ahci_cmd_table), 128);
+    port->bounce = (u8 *)kmalloc_aligned(AHCI_BOUNCE_SECTORS * 512, 4);
+
+    if (!port->clist || !port->fis || !port->tables || !port->bounce) {
+        print("AHCI   : ERROR - Cannot allocate port structures\n");
+        return NULL;
+    }
+
+    memset(port->clist, 0, AHCI_MAX_SLOTS * sizeof(struct ahci_cmd_header));
+    memset(port->fis, 0, 256);
+    for (i = 0; i < AHCI_MAX_SLOTS; i++) {
+        port->clist[i].ctba = (u32)&port->tables[i];
+        port->clist[i].ctbau = 0;
+    }
+
+    if (ahci_port_stop(regs)) {
+        print("AHCI   : port did not stop\n");
+        return NULL;
+    }
+
+    regs->clb = (u32)port->clist;
+    regs->clbu = 0;
+    regs->fb = (u32)port->fis;
+    regs->fbu = 0;
+    regs->serr = 0xFFFFFFFF;
+    regs->is = 0xFFFFFFFF;
+    regs->cmd |= AHCI_PxCMD_SUD | AHCI_PxCMD_POD;
+
+    if (ahci_port_start(regs)) {
+        print("AHCI   : port did not start\n");
+        return NULL;
+    }
+
+    // IDENTIFY: capacidad LBA48 y soporte de NCQ (palabra 76, bit 8)
+    port->depth = 1;
+    if (ahci_identify(port, ident)) {
+        print("AHCI   : IDENTIFY failed\n");
+        return NULL;
+    }
+
+    port->sectors = ident[100] | ((u32)ident[101] << 16);
+    if (port->sectors == 0) {
+        port->sectors = ident[60] | ((u32)ident[61] << 16);
+    }
+
+    if (ahci_hba_ncq && (ident[76] & 0x0100)) {
+        port->ncq = 1;
+        port->depth = (ident[75] & 0x1F) + 1;
+        if (port->depth > ahci_hba_slots) port->depth = ahci_hba_slots;
+    } else {
+        port->depth = ahci_hba_slots;
+    }
+
+    regs->ie = AHCI_PxIE_DEFAULT;
+    return port;
+}
+
+// Probe del controlador AHCI (clase 01, subclase 06)
+static int ahci_pci_probe(struct pci_device *dev) {
+    u32 pi;
+    int i;
+
+    if (dev->bar_is_io[5] || dev->bar[5] == 0) return -1;
+
+    ahci_hba = (volatile struct ahci_hba_regs *)mm_map_mmio(dev->bar[5],
+                                                            dev->bar_size[5]);
+    if (ahci_hba == NULL) return -1;
+
+    pci_enable_device(dev);
+    pci_enable_bus_master(dev);
+
+    ahci_hba->ghc |= AHCI_GHC_AE;
+    ahci_hba_ncq = (ahci_hba->cap & AHCI_CAP_NCQ) != 0;
+    ahci_hba_slots = AHCI_CAP_NCS(ahci_hba->cap);
+
+    pi = ahci_hba->pi;
+    for (i = 0; i < AHCI_MAX_PORTS; i++) {
+        volatile struct ahci_port_regs *regs = &ahci_hba->ports[i];
+        struct ahci_port *port;
+
+        if (!(pi & (1 << i))) continue;
+        if ((regs->ssts & 0xF) != AHCI_SSTS_DET_OK) continue;
+        if (((regs->ssts >> 8) & 0xF) != AHCI_SSTS_IPM_ACTIVE) continue;
+        if (regs->sig != AHCI_SIG_ATA) continue;  // ATAPI y otros no
+
+        port = ahci_port_init(i);
+        if (port == NULL) continue;
+
+        // Nombres sda, sdb, ... en orden de puerto
+        memcpy(port->blk.name, "sda", 4);
+        port->blk.name[2] = 'a' + ahci_port_count;
+        port->blk.sectors = port->sectors;
+        port->blk.submit = ahci_blk_submit;
+        port->blk.poll = ahci_blk_poll;
+        port->blk.max_sectors = AHCI_BLK_SECTORS;
+        port->blk.max_segs = AHCI_PRDT_ENTRIES;
+        port->blk.max_inflight = port->depth;
+        port->blk.priv = port;
+
+        ahci_ports[ahci_port_count++] = port;
+
+        print("AHCI   : port ");
+        print_dec(i);
+        print(": ");
+        print_dec(port->sectors / 2048);
+        print("MB, ");
+        if (port->ncq) {
+            print("NCQ depth ");
+            print_dec(port->depth);
+        } else {
+            print("no NCQ");
+        }
+        print("\n");
+
+        blockdev_register(&port->blk);
+    }
+
+    if (ahci_port_count == 0) return -1;
+
+    if (dev->irq_pin && dev->irq_line < 16 &&
+        irq_install_handler(dev->irq_line, isr_ahci_int) == 0) {
+        ahci_hba->is = 0xFFFFFFFF;
+        ahci_hba->ghc |= AHCI_GHC_IE;
+        print("AHCI   : using IRQ ");
+        print_dec(dev->irq_line);
+        print("\n");
+    } else {
+        print("AHCI   : no usable IRQ, polling for completions\n");
+        for (i = 0; i < ahci_port_count; i++) {
+            ahci_ports[i]->blk.polled = 1;
+        }
+    }
+
+    return 0;
+}
+
+static struct pci_driver ahci_pci_driver = {
+    "ahci", PCI_ANY_ID, PCI_ANY_ID, 0x01, 0x06, ahci_pci_probe
+};
+
+// Inicialización: registra el driver PCI (los puertos se sondean en probe)
+void ahci_init(void) {
+    memset(ahci_ports, 0, sizeof(ahci_ports));
+    ahci_port_count = 0;
+
+    pci_register_driver(&ahci_pci_driver);
+}
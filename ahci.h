@@ -0,0 +1,178 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include "types.h"
+#include "blockdev.h"
+
+// Registros globales del HBA (GHC)
+#define AHCI_GHC_HR         0x00000001  // reset del HBA
+#define AHCI_GHC_IE         0x00000002  // interrupciones habilitadas
+#define AHCI_GHC_AE         0x80000000  // modo AHCI
+#define AHCI_CAP_NCQ        0x40000000  // CAP.SNCQ
+#define AHCI_CAP_NCS(cap)   ((((cap) >> 8) & 0x1F) + 1)
+
+// PxCMD
+#define AHCI_PxCMD_ST       0x00000001
+#define AHCI_PxCMD_SUD      0x00000002
+#define AHCI_PxCMD_POD      0x00000004
+#define AHCI_PxCMD_FRE      0x00000010
+#define AHCI_PxCMD_FR       0x00004000
+#define AHCI_PxCMD_CR       0x00008000
+
+// PxIS / PxIE
+#define AHCI_PxIS_DHRS      0x00000001  // D2H Register FIS
+#define AHCI_PxIS_PSS       0x00000002  // PIO Setup FIS
+#define AHCI_PxIS_DSS       0x00000004  // DMA Setup FIS
+#define AHCI_PxIS_SDBS      0x00000008  // Set Device Bits (fin de NCQ)
+#define AHCI_PxIS_TFES      0x40000000  // error en el task file
+#define AHCI_PxIS_ERRORS    0x7D800010  // todos los bits de error
+#define AHCI_PxIE_DEFAULT   (AHCI_PxIS_DHRS | AHCI_PxIS_PSS | AHCI_PxIS_DSS | \
+                             AHCI_PxIS_SDBS | AHCI_PxIS_ERRORS)
+
+// PxTFD / PxSSTS / PxSIG
+#define AHCI_TFD_BSY        0x80
+#define AHCI_TFD_DRQ        0x08
+#define AHCI_TFD_ERR        0x01
+#define AHCI_SSTS_DET_OK    0x3
+#define AHCI_SSTS_IPM_ACTIVE 0x1
+#define AHCI_SIG_ATA        0x00000101
+
+// Comandos ATA usados por el driver
+#define ATA_CMD_IDENTIFY            0xEC
+#define ATA_CMD_READ_DMA_EXT        0x25
+#define ATA_CMD_WRITE_DMA_EXT       0x35
+#define ATA_CMD_READ_FPDMA_QUEUED   0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED  0x61
+
+#define FIS_TYPE_REG_H2D    0x27
+
+// Límites del driver
+#define AHCI_MAX_PORTS      32
+#define AHCI_MAX_SLOTS      32
+#define AHCI_PRDT_ENTRIES   8
+#define AHCI_PRD_MAX_BYTES  0x400000    // 4MB por entrada PRDT
+#define AHCI_MAX_COUNT      65536       // sectores por comando (16 bits, 0 = 65536)
+#define AHCI_BOUNCE_SECTORS 128         // buffer para direcciones impares
+#define AHCI_BLK_SECTORS    8192        // por comando de la cola: 1 PRDT por segmento
+#define AHCI_TIMEOUT        1000000
+
+// Registros de un puerto (0x100 + 0x80 * n)
+struct ahci_port_regs {
+    u32 clb;
+    u32 clbu;
+    u32 fb;
+    u32 fbu;
+    u32 is;
+    u32 ie;
+    u32 cmd;
+    u32 rsv0;
+    u32 tfd;
+    u32 sig;
+    u32 ssts;
+    u32 sctl;
+    u32 serr;
+    u32 sact;
+    u32 ci;
+    u32 sntf;
+    u32 fbs;
+    u32 rsv1[11];
+    u32 vendor[4];
+} __attribute__((packed));
+
+// Registros del HBA (ABAR, BAR5)
+struct ahci_hba_regs {
+    u32 cap;
+    u32 ghc;
+    u32 is;
+    u32 pi;
+    u32 vs;
+    u32 ccc_ctl;
+    u32 ccc_pts;
+    u32 em_loc;
+    u32 em_ctl;
+    u32 cap2;
+    u32 bohc;
+    u8 rsv[0xA0 - 0x2C];
+    u8 vendor[0x100 - 0xA0];
+    struct ahci_port_regs ports[AHCI_MAX_PORTS];
+} __attribute__((packed));
+
+// Cabecera de comando (32 por puerto, 1KB alineado a 1KB)
+struct ahci_cmd_header {
+    u16 flags;          // CFL[4:0], W (bit 6), PMP[15:12]
+    u16 prdtl;          // entradas PRDT
+    volatile u32 prdbc; // bytes transferidos
+    u32 ctba;
+    u32 ctbau;
+    u32 rsv[4];
+} __attribute__((packed));
+
+#define AHCI_CMD_WRITE      0x0040
+
+// Entrada PRDT
+struct ahci_prdt_entry {
+    u32 dba;
+    u32 dbau;
+    u32 rsv;
+    u32 dbc;            // bytes - 1 (bits 21:0), bit 31: interrumpir
+} __attribute__((packed));
+
+// Tabla de comando (alineada a 128 bytes)
+struct ahci_cmd_table {
+    u8 cfis[64];
+    u8 acmd[16];
+    u8 rsv[48];
+    struct ahci_prdt_entry prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed));
+
+// FIS Register Host to Device
+struct fis_reg_h2d {
+    u8 type;
+    u8 flags;           // bit 7: comando
+    u8 command;
+    u8 featurel;
+    u8 lba0;
+    u8 lba1;
+    u8 lba2;
+    u8 device;
+    u8 lba3;
+    u8 lba4;
+    u8 lba5;
+    u8 featureh;
+    u8 countl;
+    u8 counth;
+    u8 icc;
+    u8 control;
+    u8 rsv[4];
+} __attribute__((packed));
+
+// Comando en vuelo en un slot
+struct ahci_slot {
+    void (*done)(void *arg, int status);
+    void *arg;
+};
+
+// Estado de un puerto con disco
+struct ahci_port {
+    volatile struct ahci_port_regs *regs;
+    int index;
+    struct ahci_cmd_header *clist;
+    u8 *fis;
+    struct ahci_cmd_table *tables;
+    u8 *bounce;
+    u32 sectors;
+    u8 ncq;             // la unidad y el HBA soportan NCQ
+    u8 depth;           // comandos simultáneos permitidos
+    volatile u32 busy;  // slots ocupados
+    struct ahci_slot slots[AHCI_MAX_SLOTS];
+    struct blockdev blk;
+};
+
+// Funciones
+void ahci_init(void);
+int ahci_submit(struct ahci_port *port, u32 lba, u32 count,
+                struct blk_seg *sg, int nsg, int write,
+                void (*done)(void *arg, int status), void *arg);
+void isr_ahci_int(void);
+
+#endif
@@ -0,0 +1,553 @@
+#include "bcache.h"
+#include "lib.h"
+#include "mm.h"
+#include "screen.h"
+
+/* Bloques, tabla hash y lista LRU */
+static struct bcache_buf bcache_bufs[BCACHE_BLOCKS];
+static struct bcache_buf *bcache_hash[BCACHE_HASH_SIZE];
+static struct bcache_buf *lru_head = NULL;
+static struct bcache_buf *lru_tail = NULL;
+
+/* Buffer contiguo para leer de una vez los bloques anticipados; la
+   lectura es asíncrona y la termina bcache_ra_end() */
+static u8 *bcache_ra_buf = NULL;
+static u8 bcache_ra_busy = 0;
+static volatile u8 bcache_ra_inflight = 0;
+static struct bio bcache_ra_bio;
+static struct bcache_buf *bcache_ra_batch[BCACHE_RA_MAX];
+
+struct bcache_stats bcache_stats;
+
+/* Secciones críticas: las tareas pueden ser expulsadas por el reloj */
+static u32 bcache_lock(void)
+{
+    u32 flags;
+
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags) :: "memory");
+    return flags;
+}
+
+static void bcache_unlock(u32 flags)
+{
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+}
+
+static u32 bcache_hashfn(struct blockdev *dev, u32 lba)
+{
+    return (lba ^ ((u32)dev >> 4)) & (BCACHE_HASH_SIZE - 1);
+}
+
+static void lru_remove(struct bcache_buf *b)
+{
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next;
+    else lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+    else lru_tail = b->lru_prev;
+}
+
+static void lru_push_front(struct bcache_buf *b)
+{
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = b;
+    lru_head = b;
+    if (lru_tail == NULL) lru_tail = b;
+}
+
+static void hash_remove(struct bcache_buf *b)
+{
+    struct bcache_buf **pp = &bcache_hash[bcache_hashfn(b->dev, b->lba)];
+
+    while (*pp && *pp != b)
+        pp = &(*pp)->hash_next;
+    if (*pp)
+        *pp = b->hash_next;
+    b->hash_next = NULL;
+}
+
+static void hash_insert(struct bcache_buf *b)
+{
+    u32 h = bcache_hashfn(b->dev, b->lba);
+
+    b->hash_next = bcache_hash[h];
+    bcache_hash[h] = b;
+}
+
+static struct bcache_buf *bcache_lookup(struct blockdev *dev, u32 lba)
+{
+    struct bcache_buf *b;
+
+    for (b = bcache_hash[bcache_hashfn(dev, lba)]; b; b = b->hash_next) {
+        if (b->dev == dev && b->lba == lba)
+            return b;
+    }
+    return NULL;
+}
+
+/* Espera a que termine la E/S de otro sobre un bloque (con la caché
+   bloqueada; se libera mientras se duerme) */
+static void bcache_wait_unlocked(struct bcache_buf *b, u32 flags)
+{
+    while (b->locked) {
+        // Si es la lectura anticipada, recogerla aunque no haya IRQ
+        if (bcache_ra_inflight) {
+            bcache_unlock(flags);
+            blockdev_drain(bcache_ra_bio.dev);
+            bcache_lock();
+            continue;
+        }
+        if (flags & 0x200)
+            asm volatile("sti; hlt; cli");
+    }
+}
+
+/* Suelta una referencia; devuelve 1 si conviene hacer write-back */
+static int bcache_put(struct bcache_buf *b)
+{
+    u32 flags = bcache_lock();
+    int flush;
+
+    if (b->refcnt > 0)
+        b->refcnt--;
+    if (b->refcnt == 0) {
+        lru_remove(b);
+        lru_push_front(b);
+    }
+    flush = bcache_stats.dirty > BCACHE_DIRTY_LIMIT;
+
+    bcache_unlock(flags);
+    return flush;
+}
+
+/* Inicializa la caché: todos los bloques libres en la lista LRU */
+void bcache_init(void)
+{
+    u8 *data = (u8 *)kmalloc_aligned(BCACHE_BLOCKS * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+    int i;
+
+    memset(bcache_bufs, 0, sizeof(bcache_bufs));
+    memset(bcache_hash, 0, sizeof(bcache_hash));
+    memset(&bcache_stats, 0, sizeof(bcache_stats));
+    lru_head = lru_tail = NULL;
+
+    if (data == NULL) {
+        print("bcache : ERROR - Cannot allocate cache memory\n");
+        return;
+    }
+
+    for (i = 0; i < BCACHE_BLOCKS; i++) {
+        bcache_bufs[i].data = data + i * BCACHE_BLOCK_SIZE;
+        lru_push_front(&bcache_bufs[i]);
+    }
+
+    bcache_ra_buf = (u8 *)kmalloc_aligned(BCACHE_RA_MAX * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+    bcache_ra_busy = 0;
+
+    print("bcache : ");
+    print_dec(BCACHE_BLOCKS);
+    print(" blocks (");
+    print_dec(BCACHE_BLOCKS * BCACHE_BLOCK_SIZE / 1024);
+    print("KB)\n");
+}
+
+/*
+ * Devuelve el bloque (dev, lba) con una referencia, sin leerlo. Si no
+ * está en caché se recicla el menos usado; si estaba sucio se escribe
+ * antes. Un bloque sin datos válidos se devuelve bloqueado: el llamador
+ * lo llena (bcache_read) o lo sobrescribe entero (bcache_mark_dirty).
+ */
+struct bcache_buf *bcache_get(struct blockdev *dev, u32 lba)
+{
+    struct bcache_buf *b;
+    u32 flags;
+
+    for (;;) {
+        flags = bcache_lock();
+
+        b = bcache_lookup(dev, lba);
+        if (b) {
+            if (b->locked) {
+                bcache_wait_unlocked(b, flags);
+                bcache_unlock(flags);
+                continue;
+            }
+            b->refcnt++;
+            if (!b->valid)
+                b->locked = 1;
+            bcache_unlock(flags);
+            return b;
+        }
+
+        // Buscar desde la cola LRU un bloque libre de referencias; los
+        // que no se pudieron escribir se quedan para el siguiente sync
+        for (b = lru_tail; b; b = b->lru_prev) {
+            if (b->refcnt == 0 && !b->locked && !b->wb_failed)
+                break;
+        }
+        if (b == NULL) {
+            bcache_unlock(flags);
+            print("bcache : ERROR - all blocks in use\n");
+            return NULL;
+        }
+
+        if (b->dirty) {
+            // Write-back del expulsado y volver a empezar
+            b->locked = 1;
+            bcache_unlock(flags);
+
+            if (blockdev_write(b->dev, b->lba, 1, b->data) == 0) {
+                flags = bcache_lock();
+                b->dirty = 0;
+                bcache_stats.dirty--;
+                bcache_stats.writebacks++;
+            } else {
+                // Sigue sucio y fuera de la elección: se busca otra víctima
+                print("bcache : ERROR - write-back failed, block kept dirty\n");
+                flags = bcache_lock();
+                b->wb_failed = 1;
+                bcache_stats.wb_errors++;
+            }
+            b->locked = 0;
+            bcache_unlock(flags);
+            continue;
+        }
+
+        if (b->dev) {
+            hash_remove(b);
+            bcache_stats.evictions++;
+        }
+        b->dev = dev;
+        b->lba = lba;
+        b->valid = 0;
+        b->locked = 1;
+        b->refcnt = 1;
+        hash_insert(b);
+
+        bcache_unlock(flags);
+        return b;
+    }
+}
+
+/* Devuelve el bloque con datos válidos, leyéndolo si no estaba en caché */
+struct bcache_buf *bcache_read(struct blockdev *dev, u32 lba)
+{
+    struct bcache_buf *b = bcache_get(dev, lba);
+
+    if (b == NULL)
+        return NULL;
+
+    if (b->valid) {
+        bcache_stats.hits++;
+        return b;
+    }
+
+    bcache_stats.misses++;
+    if (blockdev_read(dev, lba, 1, b->data) != 0) {
+        b->locked = 0;
+        bcache_release(b);
+        return NULL;
+    }
+
+    b->valid = 1;
+    b->locked = 0;
+    return b;
+}
+
+/* Fin de la lectura anticipada (bottom half): reparte el buffer */
+static void bcache_ra_end(struct bio *bio)
+{
+    int n = bio->count;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        struct bcache_buf *b = bcache_ra_batch[i];
+
+        if (bio->status == 0) {
+            memcpy(b->data, bcache_ra_buf + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+            b->valid = 1;
+        }
+        b->locked = 0;
+        // Sin write-back aquí: no se espera E/S desde el bottom half
+        bcache_put(b);
+    }
+    if (bio->status == 0)
+        bcache_stats.readahead += n;
+
+    bcache_ra_inflight = 0;
+    bcache_ra_busy = 0;
+}
+
+/*
+ * Lectura anticipada: pide en un solo comando el primer tramo contiguo de
+ * bloques que falten en [lba, lba + count) y vuelve sin esperar; los
+ * bloques quedan bloqueados hasta que llegan los datos. Se para en el
+ * primer bloque ya presente para no pisar datos sucios. Es solo una
+ * pista: si hay otra en curso no hace nada. Devuelve los bloques pedidos.
+ */
+int bcache_readahead(struct blockdev *dev, u32 lba, u32 count)
+{
+    struct bcache_buf **batch = bcache_ra_batch;
+    struct bcache_buf *b = NULL;
+    u32 start = lba;
+    u32 end;
+    u32 flags;
+    int n = 0;
+
+    if (count > BCACHE_RA_MAX)
+        count = BCACHE_RA_MAX;
+    end = lba + count;
+
+    flags = bcache_lock();
+    if (bcache_ra_busy || bcache_ra_buf == NULL) {
+        bcache_unlock(flags);
+        return 0;
+    }
+    bcache_ra_busy = 1;
+    bcache_unlock(flags);
+
+    // Saltar los bloques que ya están en caché
+    while (start < end) {
+        b = bcache_get(dev, start);
+        if (b == NULL || !b->valid)
+            break;
+        bcache_release(b);
+        start++;
+    }
+
+    // Reservar el tramo de bloques que faltan (quedan bloqueados)
+    if (start < end && b != NULL) {
+        batch[n++] = b;
+        while (start + n < end) {
+            b = bcache_get(dev, start + n);
+            if (b == NULL)
+                break;
+            if (b->valid) {
+                bcache_release(b);
+                break;
+            }
+            batch[n++] = b;
+        }
+    }
+
+    if (n == 0) {
+        bcache_ra_busy = 0;
+        return 0;
+    }
+
+    bcache_ra_bio.dev = dev;
+    bcache_ra_bio.lba = start;
+    bcache_ra_bio.count = n;
+    bcache_ra_bio.buf = bcache_ra_buf;
+    bcache_ra_bio.write = 0;
+    bcache_ra_inflight = 1;
+    bio_submit(&bcache_ra_bio, bcache_ra_end);
+
+    return n;
+}
+
+/*
+ * Lectura directa de un tramo al buffer del llamador, en un solo comando
+ * y sin ocupar bloques de la caché. Los bloques sucios en caché son más
+ * nuevos que el disco y se copian encima de lo leído.
+ */
+int bcache_read_direct(struct blockdev *dev, u32 lba, u32 count, void *buf)
+{
+    u8 *dest = (u8 *)buf;
+    u32 flags;
+    u32 i;
+
+    if (blockdev_read(dev, lba, count, buf) != 0)
+        return -1;
+    if (bcache_stats.dirty == 0)
+        return 0;
+
+    for (i = 0; i < count; i++) {
+        struct bcache_buf *b;
+
+        flags = bcache_lock();
+        b = bcache_lookup(dev, lba + i);
+        if (b && b->valid && b->dirty)
+            memcpy(dest + i * BCACHE_BLOCK_SIZE, b->data, BCACHE_BLOCK_SIZE);
+        bcache_unlock(flags);
+    }
+    return 0;
+}
+
+/*
+ * Escritura directa de un tramo desde el buffer del llamador, en un solo
+ * comando. Antes se espera a la E/S en curso sobre bloques del tramo (una
+ * lectura anticipada no puede solaparse con la escritura); después las
+ * copias en caché se actualizan y dejan de estar sucias.
+ */
+int bcache_write_direct(struct blockdev *dev, u32 lba, u32 count, const void *buf)
+{
+    const u8 *src = (const u8 *)buf;
+    struct bcache_buf *b;
+    u32 flags;
+    u32 i;
+
+    for (i = 0; i < count; i++) {
+        flags = bcache_lock();
+        b = bcache_lookup(dev, lba + i);
+        if (b)
+            bcache_wait_unlocked(b, flags);
+        bcache_unlock(flags);
+    }
+
+    if (blockdev_write(dev, lba, count, (void *)buf) != 0)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        flags = bcache_lock();
+        b = bcache_lookup(dev, lba + i);
+        if (b && !b->locked) {
+            memcpy(b->data, src + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+            b->valid = 1;
+            if (b->dirty) {
+                b->dirty = 0;
+                bcache_stats.dirty--;
+            }
+            b->wb_failed = 0;
+        }
+        bcache_unlock(flags);
+    }
+    return 0;
+}
+
+/* Marca el bloque como modificado; se escribirá al expulsarlo o en sync */
+void bcache_mark_dirty(struct bcache_buf *b)
+{
+    u32 flags = bcache_lock();
+
+    if (!b->dirty) {
+        b->dirty = 1;
+        bcache_stats.dirty++;
+    }
+    b->valid = 1;
+    b->locked = 0;
+
+    bcache_unlock(flags);
+}
+
+/* Suelta una referencia; el bloque pasa a ser el más reciente */
+void bcache_release(struct bcache_buf *b)
+{
+    if (bcache_put(b))
+        bcache_sync(NULL);
+}
+
+/*
+ * Escribe los bloques sucios de un dispositivo en lotes de bio enviadas
+ * con la cola retenida, para que el elevador las ordene y fusione. Los
+ * bloques con referencias se dejan para el siguiente sync.
+ */
+static int bcache_sync_dev(struct blockdev *dev)
+{
+    struct bcache_buf *batch[BCACHE_SYNC_BATCH];
+    struct bio bios[BCACHE_SYNC_BATCH];
+    int written = 0;
+    int errors = 0;
+    u32 flags;
+    int i, n;
+
+    do {
+        n = 0;
+        flags = bcache_lock();
+        for (i = 0; i < BCACHE_BLOCKS && n < BCACHE_SYNC_BATCH; i++) {
+            struct bcache_buf *b = &bcache_bufs[i];
+
+            if (b->dev == dev && b->dirty && !b->locked && b->refcnt == 0) {
+                b->locked = 1;
+                batch[n++] = b;
+            }
+        }
+        bcache_unlock(flags);
+
+        if (n == 0)
+            break;
+
+        blockdev_plug(dev);
+        for (i = 0; i < n; i++) {
+            bios[i].dev = dev;
+            bios[i].lba = batch[i]->lba;
+            bios[i].count = 1;
+            bios[i].buf = batch[i]->data;
+            bios[i].write = 1;
+            blockdev_submit_bio(&bios[i]);
+        }
+        blockdev_unplug(dev);
+
+        for (i = 0; i < n; i++) {
+            int status = blockdev_wait(&bios[i]);
+
+            flags = bcache_lock();
+            if (status == 0) {
+                batch[i]->dirty = 0;
+                batch[i]->wb_failed = 0;
+                bcache_stats.dirty--;
+                bcache_stats.writebacks++;
+                written++;
+            } else {
+                batch[i]->wb_failed = 1;
+                bcache_stats.wb_errors++;
+                errors++;
+            }
+            batch[i]->locked = 0;
+            bcache_unlock(flags);
+        }
+    } while (n == BCACHE_SYNC_BATCH && errors == 0);
+
+    if (errors) {
+        print("bcache : ERROR - ");
+        print_dec(errors);
+        print(" blocks failed to write back\n");
+    }
+    return written;
+}
+
+/* Escribe los bloques sucios de 'dev' (o de todos si es NULL) */
+int bcache_sync(struct blockdev *dev)
+{
+    struct blockdev *d;
+    int written = 0;
+    int i;
+
+    if (dev)
+        return bcache_sync_dev(dev);
+
+    for (i = 0; (d = blockdev_get(i)) != NULL; i++) {
+        written += bcache_sync_dev(d);
+    }
+    return written;
+}
+
+/* Estadísticas de la caché (parte de 'fsstat') */
+void bcache_print_stats(void)
+{
+    u32 lookups = bcache_stats.hits + bcache_stats.misses;
+
+    print("Buffer cache: ");
+    print_dec(BCACHE_BLOCKS);
+    print(" blocks\n");
+    print("  Hits: ");
+    print_dec(bcache_stats.hits);
+    print("  Misses: ");
+    print_dec(bcache_stats.misses);
+    if (lookups) {
+        print("  Hit rate: ");
+        print_dec(bcache_stats.hits * 100 / lookups);
+        print("%");
+    }
+    print("\n  Dirty: ");
+    print_dec(bcache_stats.dirty);
+    print("  Write-backs: ");
+    print_dec(bcache_stats.writebacks);
+    print("  Evictions: ");
+    print_dec(bcache_stats.evictions);
+    print("\n  Read-ahead: ");
+    print_dec(bcache_stats.readahead);
+    print(" blocks  Write-back errors: ");
+    print_dec(bcache_stats.wb_errors);
+    print("\n");
+}
@@ -0,0 +1,57 @@
+#ifndef BCACHE_H_
+#define BCACHE_H_
+
+#include "types.h"
+#include "blockdev.h"
+
+#define BCACHE_BLOCK_SIZE   512         /* un sector por bloque */
+#define BCACHE_BLOCKS       256         /* 128KB de sectores en memoria */
+#define BCACHE_HASH_SIZE    64          /* potencia de 2 */
+#define BCACHE_DIRTY_LIMIT  192         /* por encima se fuerza un sync */
+#define BCACHE_SYNC_BATCH   32          /* bio por lote de write-back */
+#define BCACHE_RA_MAX       64          /* sectores por lectura anticipada */
+
+/*
+ * Bloque en caché. Mientras refcnt > 0 el bloque no se expulsa ni se
+ * escribe; 'locked' indica una E/S en curso sobre su contenido.
+ */
+struct bcache_buf {
+    struct blockdev *dev;               /* NULL = libre */
+    u32 lba;
+    u8 *data;                           /* 512 bytes */
+    u8 valid;
+    u8 dirty;
+    volatile u8 locked;
+    u8 wb_failed;                       /* falló su write-back: no se expulsa */
+    u16 refcnt;
+    struct bcache_buf *hash_next;
+    struct bcache_buf *lru_prev;        /* lista LRU: cabeza = más reciente */
+    struct bcache_buf *lru_next;
+};
+
+/* Contadores de la caché */
+struct bcache_stats {
+    u32 hits;
+    u32 misses;
+    u32 evictions;
+    u32 writebacks;                     /* bloques sucios escritos a disco */
+    u32 dirty;                          /* bloques sucios ahora */
+    u32 readahead;                      /* bloques traídos por adelantado */
+    u32 wb_errors;                      /* write-backs fallidos (el bloque sigue sucio) */
+};
+
+extern struct bcache_stats bcache_stats;
+
+/* Funciones */
+void bcache_init(void);
+struct bcache_buf *bcache_read(struct blockdev *dev, u32 lba);
+struct bcache_buf *bcache_get(struct blockdev *dev, u32 lba);
+void bcache_mark_dirty(struct bcache_buf *b);
+void bcache_release(struct bcache_buf *b);
+int bcache_sync(struct blockdev *dev);
+int bcache_readahead(struct blockdev *dev, u32 lba, u32 count);
+int bcache_read_direct(struct blockdev *dev, u32 lba, u32 count, void *buf);
+int bcache_write_direct(struct blockdev *dev, u32 lba, u32 count, const void *buf);
+void bcache_print_stats(void);
+
+#endif
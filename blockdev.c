@@ -0,0 +1,785 @@
+#include "blockdev.h"
+#include "cpu.h"
+#include "idt.h"
+#include "lib.h"
+#include "mm.h"
+#include "screen.h"
+
+/* Dispositivos registrados */
+static struct blockdev *blockdevs[BLOCKDEV_MAX];
+static int blockdev_count = 0;
+
+/* bio asíncronas terminadas, pendientes de su callback (FIFO) */
+static struct bio *blk_done_head = NULL;
+static struct bio *blk_done_tail = NULL;
+static int blk_bh = -1;
+
+/* Secciones críticas frente a las IRQ de los drivers */
+static u32 blk_irq_save(void)
+{
+    u32 flags;
+
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags) :: "memory");
+    return flags;
+}
+
+static void blk_irq_restore(u32 flags)
+{
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+}
+
+/* Bottom half: ejecuta los callbacks de las bio asíncronas terminadas */
+static void blk_run_callbacks(void)
+{
+    struct bio *bio, *next;
+    u32 flags = blk_irq_save();
+
+    bio = blk_done_head;
+    blk_done_head = blk_done_tail = NULL;
+    blk_irq_restore(flags);
+
+    for (; bio; bio = next) {
+        next = bio->next;
+        bio->next = NULL;
+        bio->end_io(bio);
+    }
+}
+
+/* Termina una bio; las asíncronas pasan a la lista del bottom half */
+static void blk_end_bio(struct bio *bio, int status)
+{
+    bio->next = NULL;
+    bio->status = status;
+    bio->done = 1;
+
+    if (bio->end_io == NULL || blk_bh < 0)
+        return;
+
+    if (blk_done_tail)
+        blk_done_tail->next = bio;
+    else
+        blk_done_head = bio;
+    blk_done_tail = bio;
+    bh_raise(blk_bh);
+}
+
+/*
+ * Registra un dispositivo; devuelve su índice o -1 si la tabla está
+ * llena. Los límites que el driver deja a 0 toman valores conservadores.
+ */
+int blockdev_register(struct blockdev *dev)
+{
+    if (blockdev_count >= BLOCKDEV_MAX) {
+        print("blkdev : ERROR - device table full\n");
+        return -1;
+    }
+
+    if (dev->max_inflight == 0)
+        dev->max_inflight = 1;
+    if (dev->max_segs == 0)
+        dev->max_segs = 1;
+    if (dev->max_segs > BLK_MAX_SEGS)
+        dev->max_segs = BLK_MAX_SEGS;
+    if (dev->max_sectors == 0)
+        dev->max_sectors = BLK_DEFAULT_SECTORS;
+
+    if (blk_bh < 0)
+        blk_bh = bh_install(blk_run_callbacks);
+
+    dev->rqs = (struct blk_request *)kmalloc(dev->max_inflight * sizeof(struct blk_request));
+    if (dev->rqs == NULL) {
+        print("blkdev : ERROR - cannot allocate request pool\n");
+        return -1;
+    }
+    memset(dev->rqs, 0, dev->max_inflight * sizeof(struct blk_request));
+
+    dev->queue = NULL;
+    dev->queued = 0;
+    dev->inflight = 0;
+    dev->head_pos = 0;
+    dev->plugged = 0;
+    dev->dispatching = 0;
+    memset(&dev->stats, 0, sizeof(struct blockdev_stats));
+
+    blockdevs[blockdev_count] = dev;
+
+    print("blkdev : ");
+    print(dev->name);
+    print(" registered (");
+    print_dec(dev->sectors / 2048);
+    print("MB, depth ");
+    print_dec(dev->max_inflight);
+    print(")\n");
+
+    return blockdev_count++;
+}
+
+/* Busca un dispositivo por nombre ("hda", "sda", ...) */
+struct blockdev *blockdev_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < blockdev_count; i++) {
+        if (strcmp(blockdevs[i]->name, name) == 0)
+            return blockdevs[i];
+    }
+    return NULL;
+}
+
+/* Devuelve el dispositivo 'index' en orden de registro */
+struct blockdev *blockdev_get(int index)
+{
+    if (index < 0 || index >= blockdev_count)
+        return NULL;
+    return blockdevs[index];
+}
+
+/* Cubo log2 de un tiempo en microsegundos */
+static int blk_hist_bucket(u32 us)
+{
+    int i = 0;
+
+    while (us > 1 && i < BLK_HIST_BUCKETS - 1) {
+        us >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/* Inserta una bio en la cola manteniendo el orden por LBA (estable) */
+static void blk_queue_insert(struct blockdev *dev, struct bio *bio)
+{
+    struct bio **pp = &dev->queue;
+
+    while (*pp && (*pp)->lba <= bio->lba)
+        pp = &(*pp)->next;
+
+    bio->next = *pp;
+    *pp = bio;
+    dev->queued++;
+}
+
+/*
+ * Elevador C-LOOK: la siguiente bio es la primera a partir de la posición
+ * del último comando; al llegar al final se vuelve a la de menor LBA.
+ */
+static struct bio **blk_queue_pick(struct blockdev *dev)
+{
+    struct bio **pp;
+
+    for (pp = &dev->queue; *pp; pp = &(*pp)->next) {
+        if ((*pp)->lba >= dev->head_pos)
+            return pp;
+    }
+    return &dev->queue;
+}
+
+/* Añade una bio al final de un comando, ampliando el último segmento si
+   su buffer es contiguo en memoria */
+static void blk_request_add(struct blk_request *rq, struct bio *bio, struct bio **tail)
+{
+    struct blk_seg *seg = rq->nseg ? &rq->segs[rq->nseg - 1] : NULL;
+
+    if (seg && (u8 *)seg->buf + seg->count * 512 == (u8 *)bio->buf) {
+        seg->count += bio->count;
+    } else {
+        rq->segs[rq->nseg].buf = bio->buf;
+        rq->segs[rq->nseg].count = bio->count;
+        rq->nseg++;
+    }
+
+    rq->count += bio->count;
+    bio->next = NULL;
+    if (*tail)
+        (*tail)->next = bio;
+    else
+        rq->bios = bio;
+    *tail = bio;
+}
+
+/* Una bio se fusiona si continúa el comando en disco y caben sus límites */
+static int blk_can_merge(struct blockdev *dev, struct blk_request *rq, struct bio *bio)
+{
+    struct blk_seg *seg = &rq->segs[rq->nseg - 1];
+
+    if (bio->write != rq->write || bio->lba != rq->lba + rq->count)
+        return 0;
+    if (rq->count + bio->count > dev->max_sectors)
+        return 0;
+    if ((u8 *)seg->buf + seg->count * 512 != (u8 *)bio->buf && rq->nseg >= dev->max_segs)
+        return 0;
+    return 1;
+}
+
+/* Saca de la cola la siguiente bio y todas las contiguas que la siguen */
+static struct blk_request *blk_build_request(struct blockdev *dev)
+{
+    struct blk_request *rq = NULL;
+    struct bio **pp;
+    struct bio *bio, *tail = NULL;
+    int i;
+
+    for (i = 0; i < dev->max_inflight; i++) {
+        if (!dev->rqs[i].in_use) {
+            rq = &dev->rqs[i];
+            break;
+        }
+    }
+    if (rq == NULL)
+        return NULL;
+
+    pp = blk_queue_pick(dev);
+    bio = *pp;
+    *pp = bio->next;
+    dev->queued--;
+
+    rq->dev = dev;
+    rq->lba = bio->lba;
+    rq->count = 0;
+    rq->write = bio->write;
+    rq->nseg = 0;
+    rq->bios = NULL;
+    rq->in_use = 1;
+    blk_request_add(rq, bio, &tail);
+
+    // La cola está ordenada: las candidatas a fusión van justo detrás
+    while (*pp && blk_can_merge(dev, rq, *pp)) {
+        bio = *pp;
+        *pp = bio->next;
+        dev->queued--;
+        blk_request_add(rq, bio, &tail);
+        dev->stats.merges++;
+    }
+
+    dev->inflight++;
+    return rq;
+}
+
+/*
+ * Estadísticas y posición del cabezal de un comando que el driver ha
+ * aceptado. Con BLK_BUSY no se anota nada: se volverá a construir.
+ */
+static void blk_account(struct blockdev *dev, int write, u32 lba, u32 count, u32 depth)
+{
+    if (write) {
+        dev->stats.writes++;
+        dev->stats.write_sectors += count;
+    } else {
+        dev->stats.reads++;
+        dev->stats.read_sectors += count;
+    }
+
+    // Profundidad vista por este comando: lo que quedaba en cola + en vuelo
+    dev->stats.depth_sum += depth;
+    if (depth > dev->stats.depth_max)
+        dev->stats.depth_max = depth;
+
+    dev->head_pos = lba + count;
+}
+
+/* Devuelve a la cola las bio de un comando que el driver no aceptó */
+static void blk_requeue(struct blk_request *rq)
+{
+    struct blockdev *dev = rq->dev;
+    struct bio *bio, *next;
+
+    for (bio = rq->bios; bio; bio = next) {
+        next = bio->next;
+        blk_queue_insert(dev, bio);
+    }
+    rq->bios = NULL;
+    rq->in_use = 0;
+    dev->inflight--;
+}
+
+/*
+ * Entrega comandos al driver mientras haya bio en cola y sitio en vuelo.
+ * submit() se llama con las interrupciones como las tenía el llamador,
+ * así un driver síncrono puede seguir durmiendo con hlt. Si la cola se
+ * procesa ya más arriba en la pila (completado síncrono), no se reentra.
+ */
+static void blk_run_queue(struct blockdev *dev)
+{
+    struct blk_request *rq;
+    u32 flags = blk_irq_save();
+    u32 lba, count, depth;
+    int submitted = 0;
+    int write, ret;
+
+    if (dev->dispatching || dev->plugged) {
+        blk_irq_restore(flags);
+        return;
+    }
+    dev->dispatching = 1;
+
+    while (dev->queue && dev->inflight < dev->max_inflight) {
+        rq = blk_build_request(dev);
+        if (rq == NULL)
+            break;
+
+        // Un driver síncrono completa (y suelta) el comando dentro de
+        // submit(): lo que hace falta después se guarda antes
+        write = rq->write;
+        lba = rq->lba;
+        count = rq->count;
+        depth = dev->queued + dev->inflight;
+        rq->start = cpu_cycles();
+
+        blk_irq_restore(flags);
+        ret = dev->submit(dev, rq);
+        flags = blk_irq_save();
+
+        if (ret == BLK_BUSY) {
+            blk_requeue(rq);
+            break;
+        }
+        if (ret < 0) {
+            blk_irq_restore(flags);
+            blockdev_complete(rq, -1);
+            flags = blk_irq_save();
+            continue;
+        }
+        blk_account(dev, write, lba, count, depth);
+        submitted++;
+    }
+
+    if (submitted && dev->kick)
+        dev->kick(dev);
+
+    dev->dispatching = 0;
+    blk_irq_restore(flags);
+}
+
+static void blk_submit(struct bio *bio)
+{
+    struct blockdev *dev = bio->dev;
+    u32 flags;
+
+    bio->done = 0;
+    bio->status = 0;
+
+    if (dev == NULL || bio->count == 0 || bio->count > dev->max_sectors ||
+        bio->lba + bio->count > dev->sectors || bio->lba + bio->count < bio->lba) {
+        flags = blk_irq_save();
+        blk_end_bio(bio, -1);
+        blk_irq_restore(flags);
+        return;
+    }
+
+    bio->start = cpu_cycles();
+
+    flags = blk_irq_save();
+    dev->stats.bios++;
+    blk_queue_insert(dev, bio);
+    blk_irq_restore(flags);
+
+    blk_run_queue(dev);
+}
+
+/* Relanza la cola, p.ej. cuando el driver vuelve a tener sitio después
+   de devolver BLK_BUSY sin comandos propios en vuelo */
+void blockdev_run_queue(struct blockdev *dev)
+{
+    blk_run_queue(dev);
+}
+
+/*
+ * Encola una bio. No espera: el llamador usa blockdev_wait(). Las bio no
+ * pueden superar max_sectors (blockdev_read/write ya las trocean).
+ */
+void blockdev_submit_bio(struct bio *bio)
+{
+    bio->end_io = NULL;
+    blk_submit(bio);
+}
+
+/*
+ * Envío asíncrono: end_io(bio) se llama al terminar desde el bottom half
+ * de la IRQ (o en el acto si el driver es síncrono o la bio no es
+ * válida), con bio->status ya fijado. No se debe esperar con
+ * blockdev_wait una bio cuyo callback la reutilice o la libere.
+ */
+void bio_submit(struct bio *bio, void (*end_io)(struct bio *bio))
+{
+    bio->end_io = end_io;
+    blk_submit(bio);
+
+    // Un driver síncrono ya la ha terminado: no esperar a la próxima IRQ
+    bh_run();
+}
+
+/*
+ * Espera a que termine una bio. Con interrupciones se duerme con hlt y
+ * se consulta el driver en cada despertar; durante el arranque (IF=0) o
+ * en dispositivos sin IRQ se consulta en bucle.
+ */
+int blockdev_wait(struct bio *bio)
+{
+    struct blockdev *dev = bio->dev;
+    u32 flags;
+    int irqs;
+
+    if (bio->done)
+        return bio->status;
+
+    flags = blk_irq_save();
+    irqs = (flags & 0x200) != 0;
+
+    while (!bio->done) {
+        if (dev->poll)
+            dev->poll(dev);
+        if (bio->done)
+            break;
+        if (irqs && !dev->polled)
+            asm volatile("sti; hlt; cli");
+    }
+
+    blk_irq_restore(flags);
+    return bio->status;
+}
+
+/*
+ * Espera a que el dispositivo no tenga nada en vuelo ni en cola (salvo
+ * retenida) y a que se hayan ejecutado los callbacks, que pueden enviar
+ * más bio. Sirve también para dispositivos sin IRQ o durante el arranque.
+ */
+void blockdev_drain(struct blockdev *dev)
+{
+    u32 flags = blk_irq_save();
+    int irqs = (flags & 0x200) != 0;
+
+    for (;;) {
+        if (dev->inflight || (dev->queue && !dev->plugged)) {
+            if (dev->inflight == 0) {
+                blk_irq_restore(flags);
+                blk_run_queue(dev);
+                flags = blk_irq_save();
+                continue;
+            }
+            if (dev->poll)
+                dev->poll(dev);
+            if (irqs && !dev->polled && dev->inflight)
+                asm volatile("sti; hlt; cli");
+            continue;
+        }
+        if (blk_done_head == NULL)
+            break;
+
+        // Directamente: el bottom half puede estar ya en curso más abajo
+        blk_irq_restore(flags);
+        blk_run_callbacks();
+        flags = blk_irq_save();
+    }
+
+    blk_irq_restore(flags);
+}
+
+/*
+ * Llamada por el driver al terminar un comando (en la IRQ o dentro de
+ * submit). Marca sus bio como hechas y deja pasar al siguiente.
+ */
+void blockdev_complete(struct blk_request *rq, int status)
+{
+    struct blockdev *dev = rq->dev;
+    struct bio *bio, *next;
+    u64 now = cpu_cycles();
+    u32 us = cpu_cycles_to_us(now - rq->start);
+    u32 flags = blk_irq_save();
+
+    dev->stats.service_hist[blk_hist_bucket(us)]++;
+    dev->stats.busy_us += us;
+    if (status)
+        dev->stats.errors++;
+
+    for (bio = rq->bios; bio; bio = next) {
+        next = bio->next;
+        dev->stats.latency_hist[blk_hist_bucket(cpu_cycles_to_us(now - bio->start))]++;
+        blk_end_bio(bio, status);
+    }
+    rq->bios = NULL;
+    rq->in_use = 0;
+    dev->inflight--;
+
+    blk_irq_restore(flags);
+    blk_run_queue(dev);
+}
+
+/* Retener la cola para acumular bio y fusionarlas antes de enviarlas */
+void blockdev_plug(struct blockdev *dev)
+{
+    u32 flags = blk_irq_save();
+
+    dev->plugged++;
+    blk_irq_restore(flags);
+}
+
+void blockdev_unplug(struct blockdev *dev)
+{
+    u32 flags = blk_irq_save();
+
+    if (dev->plugged)
+        dev->plugged--;
+    blk_irq_restore(flags);
+
+    blk_run_queue(dev);
+}
+
+/*
+ * Lectura/escritura síncrona: se trocea en bio de max_sectors que se
+ * envían juntas con la cola retenida y se esperan al final.
+ */
+static int blockdev_rw(struct blockdev *dev, u32 lba, u32 count, void *buffer, int write)
+{
+    struct bio bios[BLK_SYNC_BIOS];
+    u8 *buf = (u8 *)buffer;
+    int status = 0;
+    int i, n;
+
+    if (dev == NULL || lba + count > dev->sectors || lba + count < lba)
+        return -1;
+
+    while (count > 0) {
+        blockdev_plug(dev);
+        for (n = 0; n < BLK_SYNC_BIOS && count > 0; n++) {
+            u32 c = (count < dev->max_sectors) ? count : dev->max_sectors;
+
+            bios[n].dev = dev;
+            bios[n].lba = lba;
+            bios[n].count = c;
+            bios[n].buf = buf;
+            bios[n].write = write;
+            blockdev_submit_bio(&bios[n]);
+
+            lba += c;
+            buf += c * 512;
+            count -= c;
+        }
+        blockdev_unplug(dev);
+
+        for (i = 0; i < n; i++) {
+            if (blockdev_wait(&bios[i]))
+                status = -1;
+        }
+        if (status)
+            return -1;
+    }
+
+    return 0;
+}
+
+int blockdev_read(struct blockdev *dev, u32 lba, u32 count, void *buf)
+{
+    return blockdev_rw(dev, lba, count, buf, 0);
+}
+
+int blockdev_write(struct blockdev *dev, u32 lba, u32 count, void *buf)
+{
+    return blockdev_rw(dev, lba, count, buf, 1);
+}
+
+/* Lista los dispositivos (comando 'lsblk') */
+void blockdev_list(void)
+{
+    int i;
+    u32 j;
+
+    print("Name     Size                    Depth  Max I/O\n");
+    print("----     ----                    -----  -------\n");
+    for (i = 0; i < blockdev_count; i++) {
+        struct blockdev *dev = blockdevs[i];
+
+        print(dev->name);
+        for (j = strlen(dev->name); j < 9; j++) {
+            print(" ");
+        }
+        print_dec(dev->sectors / 2048);
+        print("MB (");
+        print_dec(dev->sectors);
+        print(" sectors)  ");
+        print_dec(dev->max_inflight);
+        print("      ");
+        print_dec(dev->max_sectors / 2);
+        print("KB x");
+        print_dec(dev->max_segs);
+        print("\n");
+    }
+}
+
+static void blk_print_hist(const char *title, u32 *hist)
+{
+    u32 max = 0;
+    u32 j, bar;
+    int i;
+
+    for (i = 0; i < BLK_HIST_BUCKETS; i++) {
+        if (hist[i] > max)
+            max = hist[i];
+    }
+    if (max == 0)
+        return;
+
+    print("  ");
+    print((char *)title);
+    print(" (us):\n");
+    for (i = 0; i < BLK_HIST_BUCKETS; i++) {
+        if (hist[i] == 0)
+            continue;
+        print("    ");
+        print_dec(i ? 1 << i : 0);
+        print(i < BLK_HIST_BUCKETS - 1 ? "-" : "+");
+        if (i < BLK_HIST_BUCKETS - 1)
+            print_dec(1 << (i + 1));
+        print(": ");
+        print_dec(hist[i]);
+        print(" ");
+        bar = hist[i] * 30 / max;
+        for (j = 0; j < (bar ? bar : 1); j++)
+            putcar('#');
+        print("\n");
+    }
+}
+
+/* Estadísticas de un dispositivo (comando 'iostat') */
+void blockdev_print_iostat(struct blockdev *dev)
+{
+    struct blockdev_stats *st = &dev->stats;
+    u32 cmds = st->reads + st->writes;
+
+    print(dev->name);
+    print(": ");
+    print_dec(st->bios);
+    print(" bios -> ");
+    print_dec(cmds);
+    print(" cmds (");
+    print_dec(st->merges);
+    print(" merged), ");
+    print_dec(st->errors);
+    print(" errors\n");
+
+    print("  read:  ");
+    print_dec(st->reads);
+    print(" cmds, ");
+    print_dec(st->read_sectors / 2);
+    print("KB   write: ");
+    print_dec(st->writes);
+    print(" cmds, ");
+    print_dec(st->write_sectors / 2);
+    print("KB\n");
+
+    print("  queue depth: avg ");
+    if (cmds) {
+        print_dec(st->depth_sum / cmds);
+        print(".");
+        print_dec((st->depth_sum * 10 / cmds) % 10);
+    } else {
+        print("0");
+    }
+    print(", max ");
+    print_dec(st->depth_max);
+    print(", now ");
+    print_dec(dev->queued + dev->inflight);
+    print("   busy ");
+    print_dec(st->busy_us / 1000);
+    print("ms");
+    if (cmds) {
+        print(", avg service ");
+        print_dec(st->busy_us / cmds);
+        print("us");
+    }
+    print("\n");
+
+    if (cpu_info.tsc_mhz == 0) {
+        print("  (no TSC: latency histograms unavailable)\n");
+        return;
+    }
+    blk_print_hist("service time", st->service_hist);
+    blk_print_hist("bio latency", st->latency_hist);
+}
+
+void blockdev_reset_iostat(struct blockdev *dev)
+{
+    u32 flags = blk_irq_save();
+
+    memset(&dev->stats, 0, sizeof(struct blockdev_stats));
+    blk_irq_restore(flags);
+}
+
+/* Imprime el volumen leído, KB/s y operaciones por segundo */
+static void blockdev_bench_report(const char *label, u32 sectors, u32 ios, u32 us)
+{
+    u32 ms = us / 1000 ? us / 1000 : 1;
+
+    print("  ");
+    print((char *)label);
+    print(": ");
+    print_dec(sectors / 2);
+    print("KB in ");
+    print_dec(ms);
+    print("ms = ");
+    print_dec((sectors / 2) * 1000 / ms);
+    print(" KB/s, ");
+    print_dec(ios * 1000 / ms);
+    print(" IO/s\n");
+}
+
+/*
+ * Mide el rendimiento de lectura de un dispositivo: lectura secuencial
+ * en peticiones de BENCH_SEQ_CHUNK sectores y lecturas aleatorias de 4KB
+ * (comando 'blkbench'). Solo lee, así que es seguro sobre el disco del fs.
+ */
+void blockdev_bench(struct blockdev *dev)
+{
+    u8 *buf;
+    u64 start;
+    u32 lba, seq, i, us;
+    u32 seed = 12345;
+
+    if (cpu_info.tsc_mhz == 0) {
+        print("blkbench: no TSC available for timing\n");
+        return;
+    }
+    if (dev->sectors < BENCH_SEQ_CHUNK) {
+        print("blkbench: device too small\n");
+        return;
+    }
+
+    buf = (u8 *)kmalloc(BENCH_SEQ_CHUNK * 512);
+    if (buf == NULL) {
+        print("blkbench: out of memory\n");
+        return;
+    }
+
+    seq = BENCH_SEQ_SECTORS;
+    if (seq > dev->sectors) seq = dev->sectors - dev->sectors % BENCH_SEQ_CHUNK;
+
+    print(dev->name);
+    print(":\n");
+
+    /* Secuencial */
+    start = cpu_cycles();
+    for (lba = 0; lba < seq; lba += BENCH_SEQ_CHUNK) {
+        if (blockdev_read(dev, lba, BENCH_SEQ_CHUNK, buf)) {
+            print("  sequential read failed\n");
+            kfree(buf);
+            return;
+        }
+    }
+    us = cpu_cycles_to_us(cpu_cycles() - start);
+    blockdev_bench_report("sequential", seq, seq / BENCH_SEQ_CHUNK, us);
+
+    /* Aleatorio: LCG sobre todo el dispositivo, alineado a 4KB */
+    start = cpu_cycles();
+    for (i = 0; i < BENCH_RAND_IOS; i++) {
+        seed = seed * 1103515245 + 12345;
+        lba = (seed % (dev->sectors / BENCH_RAND_CHUNK)) * BENCH_RAND_CHUNK;
+        if (blockdev_read(dev, lba, BENCH_RAND_CHUNK, buf)) {
+            print("  random read failed\n");
+            kfree(buf);
+            return;
+        }
+    }
+    us = cpu_cycles_to_us(cpu_cycles() - start);
+    blockdev_bench_report("random 4K ", BENCH_RAND_IOS * BENCH_RAND_CHUNK, BENCH_RAND_IOS, us);
+
+    kfree(buf);
+}
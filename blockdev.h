@@ -0,0 +1,137 @@
+#ifndef BLOCKDEV_H_
+#define BLOCKDEV_H_
+
+#include "types.h"
+
+#define BLOCKDEV_MAX        8
+#define BLOCKDEV_NAME_LEN   8
+
+/* Límites de una petición fusionada */
+#define BLK_MAX_SEGS        16          /* segmentos de memoria por comando */
+#define BLK_DEFAULT_SECTORS 128         /* si el driver no fija max_sectors */
+#define BLK_SYNC_BIOS       16          /* bio por lote en blockdev_read/write */
+
+/* Histogramas de latencia: el cubo i cuenta tiempos en [2^i, 2^(i+1)) us */
+#define BLK_HIST_BUCKETS    20
+
+/* Valores de retorno de submit() */
+#define BLK_OK              0
+#define BLK_BUSY            1           /* el driver no tiene sitio: reintentar */
+
+/* Parámetros de blockdev_bench() */
+#define BENCH_SEQ_SECTORS   8192        /* 4MB leídos en secuencia */
+#define BENCH_SEQ_CHUNK     128         /* sectores por petición secuencial */
+#define BENCH_RAND_IOS      256         /* lecturas aleatorias de 4KB */
+#define BENCH_RAND_CHUNK    8
+
+struct blockdev;
+
+/* Segmento de memoria contiguo de una transferencia (scatter/gather) */
+struct blk_seg {
+    void *buf;
+    u32 count;                      /* sectores */
+};
+
+/*
+ * Petición de E/S de un cliente (fs, shell...). Se encola en el
+ * dispositivo y el elevador la fusiona con sus vecinas. Los clientes no
+ * deben tener en vuelo peticiones que se solapen: el elevador reordena.
+ * Con bio_submit() el fin se notifica llamando a end_io desde el bottom
+ * half de la IRQ; la bio no se toca después, el callback puede reusarla.
+ */
+struct bio {
+    struct blockdev *dev;
+    u32 lba;
+    u32 count;
+    void *buf;
+    u8 write;
+    volatile u8 done;
+    int status;                     /* 0 o -1, válido cuando done = 1 */
+    u64 start;                      /* ciclos al encolarla (iostat) */
+    void (*end_io)(struct bio *bio);    /* NULL: se espera con blockdev_wait */
+    void *private;                  /* para el callback */
+    struct bio *next;
+};
+
+/* Comando entregado al driver: una o varias bio contiguas fusionadas */
+struct blk_request {
+    struct blockdev *dev;
+    u32 lba;
+    u32 count;
+    u8 write;
+    u8 in_use;
+    int nseg;
+    struct blk_seg segs[BLK_MAX_SEGS];
+    struct bio *bios;               /* bio fusionadas, en orden de LBA */
+    u64 start;                      /* ciclos al entregarlo al driver */
+};
+
+/* Contadores de E/S por dispositivo (comando 'iostat') */
+struct blockdev_stats {
+    u32 bios;                       /* peticiones de los clientes */
+    u32 reads;                      /* comandos enviados al driver */
+    u32 writes;
+    u32 read_sectors;
+    u32 write_sectors;
+    u32 merges;                     /* bio fusionadas en un comando ya abierto */
+    u32 errors;
+    u32 depth_max;                  /* máximo de bio en cola + en vuelo */
+    u32 depth_sum;                  /* suma de muestras al entregar comandos */
+    u32 busy_us;                    /* tiempo total de servicio */
+    u32 service_hist[BLK_HIST_BUCKETS];   /* entrega -> fin del comando */
+    u32 latency_hist[BLK_HIST_BUCKETS];   /* bio encolada -> terminada */
+};
+
+/*
+ * Dispositivo de bloques: la interfaz que usa el sistema de archivos.
+ * Cada driver (IDE, AHCI, virtio...) registra uno por unidad y aporta:
+ *   submit: arranca un comando y devuelve BLK_OK, BLK_BUSY o -1. El fin
+ *           se notifica con blockdev_complete(), desde la IRQ o antes de
+ *           volver si el driver es síncrono.
+ *   kick:   (opcional) avisa al hardware tras un lote de submit().
+ *   poll:   (opcional) recoge completados cuando no hay interrupciones.
+ */
+struct blockdev {
+    char name[BLOCKDEV_NAME_LEN];
+    u32 sectors;                    /* capacidad en sectores de 512 bytes */
+    int (*submit)(struct blockdev *dev, struct blk_request *rq);
+    void (*kick)(struct blockdev *dev);
+    void (*poll)(struct blockdev *dev);
+    u32 max_sectors;                /* sectores por comando */
+    u16 max_segs;                   /* segmentos por comando */
+    u16 max_inflight;               /* comandos simultáneos */
+    u8 polled;                      /* sin IRQ: esperar sin dormir */
+    void *priv;                     /* datos del driver */
+
+    /* Cola de peticiones (la gestiona blockdev.c) */
+    struct bio *queue;              /* ordenada por LBA */
+    u32 queued;
+    u32 inflight;
+    u32 head_pos;                   /* fin del último comando (C-LOOK) */
+    u8 plugged;
+    u8 dispatching;
+    struct blk_request *rqs;        /* max_inflight entradas */
+
+    struct blockdev_stats stats;
+};
+
+/* Funciones */
+int blockdev_register(struct blockdev *dev);
+struct blockdev *blockdev_find(const char *name);
+struct blockdev *blockdev_get(int index);
+void blockdev_submit_bio(struct bio *bio);
+void bio_submit(struct bio *bio, void (*end_io)(struct bio *bio));
+int blockdev_wait(struct bio *bio);
+void blockdev_drain(struct blockdev *dev);
+void blockdev_complete(struct blk_request *rq, int status);
+void blockdev_plug(struct blockdev *dev);
+void blockdev_unplug(struct blockdev *dev);
+void blockdev_run_queue(struct blockdev *dev);
+int blockdev_read(struct blockdev *dev, u32 lba, u32 count, void *buf);
+int blockdev_write(struct blockdev *dev, u32 lba, u32 count, void *buf);
+void blockdev_list(void);
+void blockdev_print_iostat(struct blockdev *dev);
+void blockdev_reset_iostat(struct blockdev *dev);
+void blockdev_bench(struct blockdev *dev);
+
+#endif
@@ -0,0 +1,333 @@
+#include "cpu.h"
+#include "io.h"
+#include "lib.h"
+#include "screen.h"
+
+/* Información del procesador */
+struct cpu_info cpu_info;
+
+/*
+ * Tabla de despacho. Arranca con las versiones genéricas para que el
+ * código que corre antes de cpu_init() (IDT, pantalla) funcione igual.
+ */
+struct cpu_dispatch cpu_dispatch = {
+    memcpy_generic,
+    memset_generic,
+    strlen_generic,
+    crc32c_generic,
+    "generic",
+    "generic",
+    "generic",
+    "generic"
+};
+
+/* Nombres para mostrar en 'cpuinfo', en el orden de los bits CPU_FEAT_* */
+static const char *cpu_feature_names[] = {
+    "fpu", "pse", "tsc", "msr", "pae", "apic", "sep", "pge", "cmov",
+    "mmx", "fxsr", "sse", "sse2", "sse3", "ssse3", "sse4.1", "sse4.2",
+    "popcnt", "erms"
+};
+
+static void cpuid(u32 leaf, u32 *eax, u32 *ebx, u32 *ecx, u32 *edx)
+{
+    asm volatile("cpuid"
+                 : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+                 : "a" (leaf), "c" (0));
+}
+
+/*
+ * Comprueba si la CPU soporta CPUID intentando cambiar el bit ID (21)
+ * de EFLAGS. En un 386/486 antiguo el bit no se puede modificar.
+ */
+static int cpu_detect_cpuid(void)
+{
+    u32 before, after;
+
+    asm volatile("pushfl\n\t"
+                 "popl %0\n\t"
+                 "movl %0, %1\n\t"
+                 "xorl $0x200000, %1\n\t"
+                 "pushl %1\n\t"
+                 "popfl\n\t"
+                 "pushfl\n\t"
+                 "popl %1\n\t"
+                 "pushl %0\n\t"
+                 "popfl"
+                 : "=&r" (before), "=&r" (after) :: "cc");
+
+    return ((before ^ after) & 0x200000) != 0;
+}
+
+static void cpu_copy_regs(char *dest, u32 a, u32 b, u32 c, u32 d)
+{
+    u32 regs[4];
+
+    regs[0] = a;
+    regs[1] = b;
+    regs[2] = c;
+    regs[3] = d;
+    memcpy(dest, regs, 16);
+}
+
+/*
+ * Habilita las instrucciones SSE en el kernel (CR0.EM=0, CR0.MP=1,
+ * CR4.OSFXSR y CR4.OSXMMEXCPT). Sin esto movdqu provoca #UD.
+ */
+static void cpu_enable_sse(void)
+{
+    u32 cr0, cr4;
+
+    asm volatile("mov %%cr0, %0" : "=r" (cr0));
+    cr0 = (cr0 & ~CR0_EM) | CR0_MP;
+    asm volatile("mov %0, %%cr0" :: "r" (cr0));
+
+    asm volatile("mov %%cr4, %0" : "=r" (cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    asm volatile("mov %0, %%cr4" :: "r" (cr4));
+
+    asm volatile("fninit");
+}
+
+/*
+ * Mide la frecuencia del TSC contando ciclos mientras el canal 2 del PIT
+ * cuenta TSC_CALIBRATE_MS milisegundos en modo 0 (one-shot).
+ */
+static void cpu_calibrate_tsc(void)
+{
+    u32 count = PIT_FREQ / (1000 / TSC_CALIBRATE_MS);
+    u64 start, end;
+
+    /* Puerta del canal 2 activa, altavoz apagado */
+    outb(PIT_CH2_GATE, (inb(PIT_CH2_GATE) & ~0x02) | 0x01);
+    outb(PIT_MODE, 0xB0);
+    outb(PIT_CH2_DATA, count & 0xFF);
+    outb(PIT_CH2_DATA, (count >> 8) & 0xFF);
+
+    start = cpu_cycles();
+    while (!(inb(PIT_CH2_GATE) & 0x20));
+    end = cpu_cycles();
+
+    cpu_info.tsc_mhz = (u32)(end - start) / (TSC_CALIBRATE_MS * 1000);
+}
+
+/* Enlaza cada kernel con la mejor implementación disponible */
+static void cpu_bind_dispatch(void)
+{
+    /* rep movs/stos existen desde el 386 */
+    cpu_dispatch.memcpy = memcpy_rep;
+    cpu_dispatch.memcpy_name = "rep movsl";
+    cpu_dispatch.memset = memset_rep;
+    cpu_dispatch.memset_name = "rep stosl";
+    cpu_dispatch.strlen = strlen_word;
+    cpu_dispatch.strlen_name = "word-at-a-time";
+
+    if (cpu_has(CPU_FEAT_ERMS)) {
+        cpu_dispatch.memcpy = memcpy_erms;
+        cpu_dispatch.memcpy_name = "rep movsb (erms)";
+        cpu_dispatch.memset = memset_erms;
+        cpu_dispatch.memset_name = "rep stosb (erms)";
+    } else if (cpu_has(CPU_FEAT_SSE2) && cpu_has(CPU_FEAT_FXSR)) {
+        cpu_dispatch.memcpy = memcpy_sse2;
+        cpu_dispatch.memcpy_name = "sse2";
+    }
+
+    if (cpu_has(CPU_FEAT_SSE42)) {
+        cpu_dispatch.crc32c = crc32c_sse42;
+        cpu_dispatch.crc32c_name = "sse4.2 crc32";
+    }
+}
+
+/*
+ * Detecta el procesador con CPUID y llena la tabla de despacho.
+ * Debe llamarse una vez al arrancar, antes de que el código caliente
+ * (fs, ide) empiece a usar memcpy/memset.
+ */
+void cpu_init(void)
+{
+    u32 eax, ebx, ecx, edx;
+
+    memset(&cpu_info, 0, sizeof(struct cpu_info));
+
+    if (!cpu_detect_cpuid()) {
+        memcpy(cpu_info.vendor, "unknown", 8);
+        print("cpu    : CPUID not supported, using generic kernels\n");
+        return;
+    }
+    cpu_info.has_cpuid = 1;
+
+    /* Hoja 0: máximo leaf y fabricante (EBX, EDX, ECX) */
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    cpu_info.max_leaf = eax;
+    cpu_copy_regs(cpu_info.vendor, ebx, edx, ecx, 0);
+    cpu_info.vendor[12] = '\0';
+
+    /* Hoja 1: familia/modelo y características */
+    if (cpu_info.max_leaf >= 1) {
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+
+        cpu_info.stepping = eax & 0xF;
+        cpu_info.model = (eax >> 4) & 0xF;
+        cpu_info.family = (eax >> 8) & 0xF;
+        if (cpu_info.family == 0xF)
+            cpu_info.family += (eax >> 20) & 0xFF;
+        if (cpu_info.family == 0x6 || cpu_info.family >= 0xF)
+            cpu_info.model |= ((eax >> 16) & 0xF) << 4;
+
+        if (edx & (1 << 0))  cpu_info.features |= CPU_FEAT_FPU;
+        if (edx & (1 << 3))  cpu_info.features |= CPU_FEAT_PSE;
+        if (edx & (1 << 4))  cpu_info.features |= CPU_FEAT_TSC;
+        if (edx & (1 << 5))  cpu_info.features |= CPU_FEAT_MSR;
+        if (edx & (1 << 6))  cpu_info.features |= CPU_FEAT_PAE;
+        if (edx & (1 << 9))  cpu_info.features |= CPU_FEAT_APIC;
+        if (edx & (1 << 11)) cpu_info.features |= CPU_FEAT_SEP;
+        if (edx & (1 << 13)) cpu_info.features |= CPU_FEAT_PGE;
+        if (edx & (1 << 15)) cpu_info.features |= CPU_FEAT_CMOV;
+        if (edx & (1 << 23)) cpu_info.features |= CPU_FEAT_MMX;
+        if (edx & (1 << 24)) cpu_info.features |= CPU_FEAT_FXSR;
+        if (edx & (1 << 25)) cpu_info.features |= CPU_FEAT_SSE;
+        if (edx & (1 << 26)) cpu_info.features |= CPU_FEAT_SSE2;
+        if (ecx & (1 << 0))  cpu_info.features |= CPU_FEAT_SSE3;
+        if (ecx & (1 << 9))  cpu_info.features |= CPU_FEAT_SSSE3;
+        if (ecx & (1 << 19)) cpu_info.features |= CPU_FEAT_SSE41;
+        if (ecx & (1 << 20)) cpu_info.features |= CPU_FEAT_SSE42;
+        if (ecx & (1 << 23)) cpu_info.features |= CPU_FEAT_POPCNT;
+    }
+
+    /* Hoja 7: características extendidas */
+    if (cpu_info.max_leaf >= 7) {
+        cpuid(7, &eax, &ebx, &ecx, &edx);
+        if (ebx & (1 << 9)) cpu_info.features |= CPU_FEAT_ERMS;
+    }
+
+    /* Cadena de marca (0x80000002..0x80000004) */
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000004) {
+        cpuid(0x80000002, &eax, &ebx, &ecx, &edx);
+        cpu_copy_regs(cpu_info.brand, eax, ebx, ecx, edx);
+        cpuid(0x80000003, &eax, &ebx, &ecx, &edx);
+        cpu_copy_regs(cpu_info.brand + 16, eax, ebx, ecx, edx);
+        cpuid(0x80000004, &eax, &ebx, &ecx, &edx);
+        cpu_copy_regs(cpu_info.brand + 32, eax, ebx, ecx, edx);
+        cpu_info.brand[48] = '\0';
+    }
+
+    if (cpu_has(CPU_FEAT_SSE) && cpu_has(CPU_FEAT_FXSR)) {
+        cpu_enable_sse();
+    }
+
+    cpu_bind_dispatch();
+
+    if (cpu_has(CPU_FEAT_TSC)) {
+        cpu_calibrate_tsc();
+    }
+
+    print("cpu    : ");
+    print(cpu_info.vendor);
+    print(" family ");
+    print_dec(cpu_info.family);
+    print(" model ");
+    print_dec(cpu_info.model);
+    print(", memcpy=");
+    print((char *)cpu_dispatch.memcpy_name);
+    print(", crc32c=");
+    print((char *)cpu_dispatch.crc32c_name);
+    if (cpu_info.tsc_mhz) {
+        print(", tsc ");
+        print_dec(cpu_info.tsc_mhz);
+        print("MHz");
+    }
+    print("\n");
+}
+
+/* Indica si la CPU tiene una característica CPU_FEAT_* */
+int cpu_has(u32 feature)
+{
+    return (cpu_info.features & feature) == feature;
+}
+
+/* Muestra la información detectada (comando 'cpuinfo') */
+void cpu_print_info(void)
+{
+    u32 i;
+
+    print("CPU Information:\n");
+    print("================\n");
+    print("Vendor: ");
+    print(cpu_info.vendor);
+    print("\n");
+
+    if (!cpu_info.has_cpuid) {
+        print("CPUID not available (386/486 class CPU)\n");
+    } else {
+        if (cpu_info.brand[0]) {
+            print("Brand: ");
+            print(cpu_info.brand);
+            print("\n");
+        }
+
+        print("Family: ");
+        print_dec(cpu_info.family);
+        print("  Model: ");
+        print_dec(cpu_info.model);
+        print("  Stepping: ");
+        print_dec(cpu_info.stepping);
+        print("\n");
+
+        if (cpu_info.tsc_mhz) {
+            print("TSC: ");
+            print_dec(cpu_info.tsc_mhz);
+            print(" MHz\n");
+        }
+
+        print("Features:");
+        for (i = 0; i < sizeof(cpu_feature_names) / sizeof(cpu_feature_names[0]); i++) {
+            if (cpu_info.features & (1 << i)) {
+                print(" ");
+                print((char *)cpu_feature_names[i]);
+            }
+        }
+        print("\n");
+    }
+
+    print("Kernels:\n");
+    print("  memcpy: ");
+    print((char *)cpu_dispatch.memcpy_name);
+    print("\n  memset: ");
+    print((char *)cpu_dispatch.memset_name);
+    print("\n  strlen: ");
+    print((char *)cpu_dispatch.strlen_name);
+    print("\n  crc32c: ");
+    print((char *)cpu_dispatch.crc32c_name);
+    print("\n");
+}
+
+/* Lee el contador de ciclos (0 si la CPU no tiene TSC) */
+u64 cpu_cycles(void)
+{
+    u32 lo, hi;
+
+    if (!(cpu_info.features & CPU_FEAT_TSC))
+        return 0;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((u64)hi << 32) | lo;
+}
+
+/*
+ * Convierte ciclos a microsegundos. La división de 64 bits se hace con
+ * dos divl para no depender de libgcc; satura en 0xFFFFFFFF.
+ */
+u32 cpu_cycles_to_us(u64 cycles)
+{
+    u32 hi = (u32)(cycles >> 32);
+    u32 lo = (u32)cycles;
+    u32 q, r;
+
+    if (cpu_info.tsc_mhz == 0)
+        return 0;
+    if (hi >= cpu_info.tsc_mhz)
+        return 0xFFFFFFFF;
+
+    asm("divl %4" : "=a" (q), "=d" (r) : "a" (lo), "d" (hi), "rm" (cpu_info.tsc_mhz));
+    return q;
+}
@@ -0,0 +1,76 @@
+#ifndef CPU_H_
+#define CPU_H_
+
+#include "types.h"
+
+/* Bits de características que registramos (independientes de CPUID) */
+#define CPU_FEAT_FPU      0x00000001
+#define CPU_FEAT_PSE      0x00000002
+#define CPU_FEAT_TSC      0x00000004
+#define CPU_FEAT_MSR      0x00000008
+#define CPU_FEAT_PAE      0x00000010
+#define CPU_FEAT_APIC     0x00000020
+#define CPU_FEAT_SEP      0x00000040      /* SYSENTER/SYSEXIT */
+#define CPU_FEAT_PGE      0x00000080
+#define CPU_FEAT_CMOV     0x00000100
+#define CPU_FEAT_MMX      0x00000200
+#define CPU_FEAT_FXSR     0x00000400
+#define CPU_FEAT_SSE      0x00000800
+#define CPU_FEAT_SSE2     0x00001000
+#define CPU_FEAT_SSE3     0x00002000
+#define CPU_FEAT_SSSE3    0x00004000
+#define CPU_FEAT_SSE41    0x00008000
+#define CPU_FEAT_SSE42    0x00010000
+#define CPU_FEAT_POPCNT   0x00020000
+#define CPU_FEAT_ERMS     0x00040000      /* rep movsb/stosb mejorado */
+
+/* Bits de CR0/CR4 usados para habilitar SSE */
+#define CR0_MP            0x00000002
+#define CR0_EM            0x00000004
+#define CR4_OSFXSR        0x00000200
+#define CR4_OSXMMEXCPT    0x00000400
+
+/* Calibración del TSC con el canal 2 del PIT (1193182 Hz) */
+#define PIT_FREQ          1193182
+#define PIT_CH2_DATA      0x42
+#define PIT_MODE          0x43
+#define PIT_CH2_GATE      0x61
+#define TSC_CALIBRATE_MS  10
+
+/* Información del procesador detectada al arrancar */
+struct cpu_info {
+    u8 has_cpuid;
+    char vendor[13];
+    char brand[49];
+    u32 max_leaf;
+    u32 family;
+    u32 model;
+    u32 stepping;
+    u32 features;
+    u32 tsc_mhz;        /* ciclos de TSC por microsegundo (0 = sin TSC) */
+};
+
+/* Tabla de despacho: cada kernel se enlaza una sola vez en cpu_init() */
+struct cpu_dispatch {
+    void *(*memcpy)(void *dest, const void *src, u32 count);
+    void *(*memset)(void *dest, u8 val, u32 count);
+    u32 (*strlen)(const char *s);
+    u32 (*crc32c)(u32 crc, const void *buf, u32 len);
+    const char *memcpy_name;
+    const char *memset_name;
+    const char *strlen_name;
+    const char *crc32c_name;
+};
+
+/* Variables globales */
+extern struct cpu_info cpu_info;
+extern struct cpu_dispatch cpu_dispatch;
+
+/* Funciones */
+void cpu_init(void);
+int cpu_has(u32 feature);
+void cpu_print_info(void);
+u64 cpu_cycles(void);
+u32 cpu_cycles_to_us(u64 cycles);
+
+#endif
@@ -2,158 +2,1810 @@
 #include "lib.h"
 #include "screen.h"
 #include "mm.h"
-#include "ide.h"
+#include "blockdev.h"
+#include "bcache.h"
+#include "journal.h"
+#include "lz.h"
+#include "cpu.h"
+
+#if FS_OP_BLOCKS > JOURNAL_OP_BLOCKS
+#error "Una operación del fs no cabe en la reserva del diario"
+#endif
 
 /* Variables globales */
-struct directory root_dir;
 struct file_descriptor open_files[MAX_FILES];
-u32 next_free_sector = 100;  // Empezar después del sector 100
 
-/* Shared sector buffer to reduce memory allocations */
-static char sector_buffer[SECTOR_SIZE];
-static u8 sector_buffer_in_use = 0;
+/* Dispositivo que respalda el sistema de archivos */
+static struct blockdev *fs_dev = NULL;
+
+/* Superbloque y bitmap de sectores libres, cacheados en memoria */
+static struct fs_superblock fs_sb;
+static u32 *fs_bitmap = NULL;
+
+/* Archivos y directorios en memoria; el 0 es siempre la raíz */
+static struct fs_inode fs_inodes[FS_INODES];
+static struct fs_inode *fs_root = &fs_inodes[0];
+static u32 fs_clock;                // para elegir el inodo más antiguo
+
+/* Caché de nombres: tabla hash por (directorio, nombre) y lista LRU */
+static struct fs_dentry fs_dentries[FS_DCACHE_SIZE];
+static struct fs_dentry *fs_dhash[FS_DCACHE_HASH];
+static struct fs_dentry *fs_dlru_head;
+static struct fs_dentry *fs_dlru_tail;
+static struct fs_dcache_stats fs_dcache_stats;
+
+/* Último trozo de un archivo comprimido, descomprimido (uno para todo el fs) */
+static struct fs_inode *fs_zino = NULL;
+static u32 fs_zidx;
+static u8 fs_zdirty;
+static u8 fs_zdata[FS_ZCHUNK];
+static u8 fs_zbuf[FS_ZCHUNK];       // el trozo tal como va en disco
+static struct fs_zstats fs_zstats;
+
+static int fs_bit_test(u32 sector) {
+    return (fs_bitmap[sector >> 5] >> (sector & 31)) & 1;
+}
+
+/* Marcar [start, start + count) como usados (used = 1) o libres */
+static void fs_bits_set(u32 start, u32 count, int used) {
+    u32 i;
+    
+    for (i = start; i < start + count; i++) {
+        if (used) {
+            fs_bitmap[i >> 5] |= 1u << (i & 31);
+        } else {
+            fs_bitmap[i >> 5] &= ~(1u << (i & 31));
+        }
+    }
+}
+
+/* Copiar al disco (vía caché y diario) los sectores del bitmap que cubren un tramo */
+static void fs_write_bitmap(u32 start, u32 count) {
+    u32 first = start / FS_BITS_PER_SECTOR;
+    u32 last = (start + count - 1) / FS_BITS_PER_SECTOR;
+    u32 k;
+    
+    for (k = first; k <= last; k++) {
+        struct bcache_buf *b = bcache_get(fs_dev, fs_sb.bitmap_start + k);
+        
+        if (b == NULL) {
+            print("fs     : ERROR - Cannot write free-space bitmap\n");
+            return;
+        }
+        memcpy(b->data, (u8 *)fs_bitmap + k * SECTOR_SIZE, SECTOR_SIZE);
+        bcache_mark_dirty(b);
+        journal_dirty(b);
+    }
+}
+
+/* Guardar el superbloque (pasa por la caché y el diario) */
+static void fs_write_super(void) {
+    struct bcache_buf *b = bcache_get(fs_dev, FS_SUPERBLOCK_SECTOR);
+    
+    if (b == NULL) {
+        print("fs     : ERROR - Cannot write superblock\n");
+        return;
+    }
+    memset(b->data, 0, SECTOR_SIZE);
+    memcpy(b->data, &fs_sb, sizeof(struct fs_superblock));
+    bcache_mark_dirty(b);
+    journal_dirty(b);
+}
+
+/*
+ * Recorre los tramos libres de la zona de datos saltando de 32 en 32 las
+ * palabras llenas o vacías del bitmap. Con 'count' > 0 devuelve el tramo
+ * más pequeño que lo contiene (best-fit, 0 si no hay); con 0, la longitud
+ * del mayor tramo libre.
+ */
+static u32 fs_scan_free(u32 count) {
+    u32 end = fs_sb.total_sectors;
+    u32 bit = fs_sb.data_start;
+    u32 best_start = 0;
+    u32 best_len = 0xFFFFFFFF;
+    u32 largest = 0;
+    
+    while (bit < end) {
+        if ((bit & 31) == 0 && fs_bitmap[bit >> 5] == 0xFFFFFFFF) {
+            bit += 32;
+            continue;
+        }
+        if (fs_bit_test(bit)) {
+            bit++;
+            continue;
+        }
+        
+        u32 run = bit;
+        while (bit < end && !fs_bit_test(bit)) {
+            if ((bit & 31) == 0 && fs_bitmap[bit >> 5] == 0 && bit + 32 <= end) {
+                bit += 32;
+            } else {
+                bit++;
+            }
+        }
+        
+        u32 len = bit - run;
+        if (len > largest) {
+            largest = len;
+        }
+        if (count && len >= count && len < best_len) {
+            best_start = run;
+            best_len = len;
+            if (len == count) {
+                break;  // Hueco exacto: no hay nada mejor
+            }
+        }
+    }
+    
+    return count ? best_start : largest;
+}
+
+/* Reservar 'count' sectores contiguos; devuelve el primero o 0 */
+static u32 fs_alloc(u32 count) {
+    u32 start;
+    
+    if (count == 0 || count > fs_sb.free_sectors) {
+        return 0;
+    }
+    
+    start = fs_scan_free(count);
+    if (start == 0) {
+        return 0;
+    }
+    
+    fs_bits_set(start, count, 1);
+    fs_sb.free_sectors -= count;
+    fs_write_bitmap(start, count);
+    fs_write_super();
+    return start;
+}
+
+/* Devolver un tramo al bitmap */
+static void fs_free(u32 start, u32 count) {
+    if (count == 0 || start < fs_sb.data_start || start + count > fs_sb.total_sectors) {
+        return;
+    }
+    
+    // Lo que el diario tenga de estos sectores ya no debe reproducirse
+    journal_revoke(start, count);
+    fs_bits_set(start, count, 0);
+    fs_sb.free_sectors += count;
+    fs_write_bitmap(start, count);
+    fs_write_super();
+}
+
+/* Reservar un tramo concreto si está libre (extender en el sitio) */
+static int fs_alloc_at(u32 start, u32 count) {
+    u32 i;
+    
+    if (count == 0 || start < fs_sb.data_start || start + count > fs_sb.total_sectors ||
+        start + count < start) {
+        return -1;
+    }
+    for (i = start; i < start + count; i++) {
+        if (fs_bit_test(i)) {
+            return -1;
+        }
+    }
+    
+    fs_bits_set(start, count, 1);
+    fs_sb.free_sectors -= count;
+    fs_write_bitmap(start, count);
+    fs_write_super();
+    return 0;
+}
+
+/* Sectores reservados por un archivo */
+static u32 fs_file_sectors(struct file_entry *file) {
+    u32 total = 0;
+    int i;
+    
+    for (i = 0; i < file->nextents; i++) {
+        total += file->extents[i].count;
+    }
+    return total;
+}
+
+/* Archivo regular sin extensiones: sus datos están en la entrada */
+static int fs_is_inline(struct file_entry *file) {
+    return file->type == FILE_TYPE_REGULAR && file->nextents == 0 &&
+           !(file->flags & FS_FLAG_COMPRESSED);
+}
+
+/*
+ * Sector absoluto del sector 'rel' del archivo (0 si está fuera) y, en
+ * *run, cuántos sectores contiguos en disco quedan desde él.
+ */
+static u32 fs_bmap(struct file_entry *file, u32 rel, u32 *run) {
+    int i;
+    
+    for (i = 0; i < file->nextents; i++) {
+        struct fs_extent *e = &file->extents[i];
+        
+        if (rel < e->count) {
+            if (run) {
+                *run = e->count - rel;
+            }
+            return e->start + rel;
+        }
+        rel -= e->count;
+    }
+    return 0;
+}
+
+/*
+ * Asegurar espacio para 'bytes'. Primero se intenta extender la última
+ * extensión en el sitio; si no, se añade otra de al menos FS_EXTENT_MIN
+ * sectores (o el mayor hueco libre si no hay uno tan grande).
+ */
+static int fs_grow(struct file_entry *file, u32 bytes) {
+    u32 need = (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    u32 have = fs_file_sectors(file);
+    
+    while (have < need) {
+        u32 extra = need - have;
+        
+        if (file->nextents > 0) {
+            struct fs_extent *last = &file->extents[file->nextents - 1];
+            
+            if (fs_alloc_at(last->start + last->count, extra) == 0) {
+                last->count += extra;
+                return 0;
+            }
+        }
+        
+        if (file->nextents >= FS_MAX_EXTENTS) {
+            return -1;  // Demasiado fragmentado
+        }
+        
+        u32 len = (extra < FS_EXTENT_MIN) ? FS_EXTENT_MIN : extra;
+        u32 start = fs_alloc(len);
+        if (start == 0) {
+            len = fs_scan_free(0);
+            if (len > extra) {
+                len = extra;
+            }
+            start = fs_alloc(len);
+            if (start == 0) {
+                return -1;  // Disco lleno
+            }
+        }
+        
+        file->extents[file->nextents].start = start;
+        file->extents[file->nextents].count = len;
+        file->nextents++;
+        have += len;
+    }
+    
+    return 0;
+}
+
+/* Liberar todas las extensiones de un archivo */
+static void fs_free_file(struct file_entry *file) {
+    int i;
+    
+    for (i = 0; i < file->nextents; i++) {
+        fs_free(file->extents[i].start, file->extents[i].count);
+    }
+    file->nextents = 0;
+}
+
+/*
+ * Liberar las extensiones de un archivo ya sin entrada en operaciones
+ * del diario de FS_GROW_STEP sectores como mucho, desde el final. Un
+ * corte entre medias solo deja sectores sin devolver.
+ */
+static void fs_free_file_steps(struct file_entry *file) {
+    while (file->nextents > 0) {
+        struct fs_extent *e = &file->extents[file->nextents - 1];
+        u32 n = (e->count > FS_GROW_STEP) ? FS_GROW_STEP : e->count;
+        
+        journal_begin();
+        fs_free(e->start + e->count - n, n);
+        e->count -= n;
+        if (e->count == 0) {
+            file->nextents--;
+        }
+    }
+}
+
+/* Hash FNV-1a del nombre, con la misma truncación que al crear */
+static u32 fs_name_hash(const char *name) {
+    u32 h = 2166136261u;
+    int i;
+    
+    for (i = 0; name[i] && i < MAX_FILENAME - 1; i++) {
+        h = (h ^ (u8)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* Compara un nombre buscado con uno guardado (truncado a MAX_FILENAME - 1) */
+static int fs_name_equal(const char *stored, const char *name) {
+    int i;
+    
+    for (i = 0; i < MAX_FILENAME - 1; i++) {
+        if (stored[i] != name[i]) {
+            return 0;
+        }
+        if (name[i] == '\0') {
+            return 1;
+        }
+    }
+    return stored[i] == '\0';
+}
+
+/* Bloque 'blk' de un directorio, leído a través de la caché */
+static struct bcache_buf *fs_dir_bread(struct fs_inode *dir, u32 blk) {
+    u32 sector = fs_bmap(&dir->entry, blk, NULL);
+    
+    return sector ? bcache_read(fs_dev, sector) : NULL;
+}
+
+/* Bloque 'blk' de un directorio en la caché, para sobrescribirlo entero */
+static struct bcache_buf *fs_dir_bget(struct fs_inode *dir, u32 blk) {
+    u32 sector = fs_bmap(&dir->entry, blk, NULL);
+    
+    return sector ? bcache_get(fs_dev, sector) : NULL;
+}
+
+static int fs_dir_read_header(struct fs_inode *dir) {
+    struct bcache_buf *b = fs_dir_bread(dir, 0);
+    
+    if (b == NULL) {
+        return -1;
+    }
+    memcpy(&dir->dir, b->data, sizeof(struct fs_dir_header));
+    bcache_release(b);
+    return (dir->dir.magic == FS_DIR_MAGIC) ? 0 : -1;
+}
+
+/* Guardar la cabecera de un directorio (pasa por la caché y el diario) */
+static int fs_dir_write_header(struct fs_inode *dir) {
+    struct bcache_buf *b = fs_dir_bget(dir, 0);
+    
+    if (b == NULL) {
+        print("fs     : ERROR - Cannot write directory\n");
+        return -1;
+    }
+    memset(b->data, 0, SECTOR_SIZE);
+    memcpy(b->data, &dir->dir, sizeof(struct fs_dir_header));
+    bcache_mark_dirty(b);
+    journal_dirty(b);
+    return 0;
+}
+
+/* Leer la entrada 'slot' de un directorio */
+static int fs_slot_read(struct fs_inode *dir, u32 slot, struct file_entry *entry) {
+    struct bcache_buf *b = fs_dir_bread(dir, slot / FS_DIR_PER_BLOCK);
+    struct fs_dir_block *db;
+    
+    if (b == NULL) {
+        return -1;
+    }
+    db = (struct fs_dir_block *)b->data;
+    memcpy(entry, &db->entries[slot % FS_DIR_PER_BLOCK], sizeof(struct file_entry));
+    bcache_release(b);
+    return 0;
+}
+
+/* Guardar la entrada 'slot' de un directorio: solo se escribe su bloque */
+static int fs_slot_write(struct fs_inode *dir, u32 slot, const struct file_entry *entry) {
+    struct bcache_buf *b = fs_dir_bread(dir, slot / FS_DIR_PER_BLOCK);
+    struct fs_dir_block *db;
+    
+    if (b == NULL) {
+        print("fs     : ERROR - Cannot write directory\n");
+        return -1;
+    }
+    db = (struct fs_dir_block *)b->data;
+    memcpy(&db->entries[slot % FS_DIR_PER_BLOCK], entry, sizeof(struct file_entry));
+    bcache_mark_dirty(b);
+    journal_dirty(b);
+    return 0;
+}
+
+/* Guardar la entrada de un archivo en su directorio (la raíz, en el superbloque) */
+static void fs_inode_write(struct fs_inode *ino) {
+    if (ino->parent == NULL) {
+        fs_sb.root = ino->entry;
+        fs_write_super();
+        return;
+    }
+    fs_slot_write(ino->parent, ino->slot, &ino->entry);
+}
+
+/*
+ * Reservar espacio para 'bytes' en operaciones del diario de hasta
+ * FS_GROW_STEP sectores, cada una con la entrada al día: un corte entre
+ * medias deja el archivo con parte del espacio, pero consistente.
+ */
+static int fs_grow_steps(struct fs_inode *ino, u32 bytes) {
+    struct file_entry *file = &ino->entry;
+    u32 need = (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    u32 have = fs_file_sectors(file);
+    
+    while (have < need) {
+        u32 want = (need - have > FS_GROW_STEP) ? have + FS_GROW_STEP : need;
+        int ret;
+        
+        journal_begin();
+        ret = fs_grow(file, want * SECTOR_SIZE);
+        fs_inode_write(ino);    // lo que sí se reservó queda en el archivo
+        if (ret != 0) {
+            return -1;
+        }
+        have = fs_file_sectors(file);
+    }
+    return 0;
+}
+
+/*
+ * Asegurar 'nblocks' bloques reservados detrás del final del directorio.
+ * El disco se reserva en tramos FS_DIR_GROWTH veces mayores para que los
+ * directorios grandes no agoten sus extensiones.
+ */
+static int fs_dir_reserve(struct fs_inode *dir, u32 nblocks) {
+    u32 need = dir->entry.size / SECTOR_SIZE + nblocks;
+    u32 have = fs_file_sectors(&dir->entry);
+    u32 want = have * FS_DIR_GROWTH;
+    int ret = 0;
+    
+    if (need <= have) {
+        return 0;
+    }
+    
+    // Sin pasar de FS_GROW_STEP de una vez: debe caber en la operación
+    if (want > have + FS_GROW_STEP) {
+        want = have + FS_GROW_STEP;
+    }
+    if (want < need) {
+        want = need;
+    }
+    if (fs_grow(&dir->entry, want * SECTOR_SIZE) != 0 &&
+        fs_grow(&dir->entry, need * SECTOR_SIZE) != 0) {
+        ret = -1;
+    }
+    fs_inode_write(dir);    // lo que sí se reservó queda en el directorio
+    return ret;
+}
+
+/* Añadir un bloque al final de un directorio; devuelve su número o 0 */
+static u32 fs_dir_alloc_block(struct fs_inode *dir) {
+    u32 blk = dir->entry.size / SECTOR_SIZE;
+    
+    if (fs_dir_reserve(dir, 1) != 0) {
+        return 0;
+    }
+    dir->entry.size += SECTOR_SIZE;
+    fs_inode_write(dir);
+    return blk;
+}
+
+/* Preparar un directorio vacío: cabecera y una hoja como raíz del árbol */
+static int fs_dir_init(struct fs_inode *dir) {
+    struct bcache_buf *b;
+    struct fs_bt_node *node;
+    
+    if (fs_grow(&dir->entry, 2 * SECTOR_SIZE) != 0) {
+        return -1;
+    }
+    dir->entry.size = 2 * SECTOR_SIZE;
+    dir->dir.magic = FS_DIR_MAGIC;
+    dir->dir.root = 1;
+    dir->dir.count = 0;
+    dir->dir.free_slot = FS_NO_SLOT;
+    
+    b = fs_dir_bget(dir, 1);
+    if (b == NULL) {
+        return -1;
+    }
+    memset(b->data, 0, SECTOR_SIZE);
+    node = (struct fs_bt_node *)b->data;
+    node->magic = FS_BT_MAGIC;
+    node->leaf = 1;
+    bcache_mark_dirty(b);
+    journal_dirty(b);
+    
+    return fs_dir_write_header(dir);
+}
+
+/*
+ * Tomar una entrada libre del directorio. Las libres forman una lista
+ * enlazada por el campo 'size'; si está vacía se añade un bloque de
+ * entradas. La cabecera la guarda el llamador.
+ */
+static u32 fs_slot_alloc(struct fs_inode *dir) {
+    struct file_entry entry;
+    u32 slot;
+    
+    if (dir->dir.free_slot == FS_NO_SLOT) {
+        u32 blk = fs_dir_alloc_block(dir);
+        struct bcache_buf *b = blk ? fs_dir_bget(dir, blk) : NULL;
+        struct fs_dir_block *db;
+        u32 i;
+    
+        if (b == NULL) {
+            return FS_NO_SLOT;
+        }
+        memset(b->data, 0, SECTOR_SIZE);
+        db = (struct fs_dir_block *)b->data;
+        db->magic = FS_DIR_BLOCK_MAGIC;
+        for (i = 0; i < FS_DIR_PER_BLOCK; i++) {
+            db->entries[i].size = (i + 1 < FS_DIR_PER_BLOCK) ? blk * FS_DIR_PER_BLOCK + i + 1 : FS_NO_SLOT;
+        }
+        bcache_mark_dirty(b);
+        journal_dirty(b);
+        dir->dir.free_slot = blk * FS_DIR_PER_BLOCK;
+    }
+    
+    slot = dir->dir.free_slot;
+    if (fs_slot_read(dir, slot, &entry) != 0) {
+        return FS_NO_SLOT;
+    }
+    dir->dir.free_slot = entry.size;
+    return slot;
+}
+
+/* Devolver una entrada a la lista de libres */
+static void fs_slot_free(struct fs_inode *dir, u32 slot) {
+    struct file_entry entry;
+    
+    memset(&entry, 0, sizeof(struct file_entry));
+    entry.size = dir->dir.free_slot;
+    fs_slot_write(dir, slot, &entry);
+    dir->dir.free_slot = slot;
+}
+
+/* Búsqueda binaria: primera clave >= hash (o > hash con 'upper') */
+static u32 fs_bt_search(struct fs_bt_node *node, u32 hash, int upper) {
+    u32 lo = 0;
+    u32 hi = node->count;
+    
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+    
+        if (node->key[mid] < hash || (upper && node->key[mid] == hash)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* Hoja más a la izquierda que puede contener 'hash' (0 si el árbol está roto) */
+static u32 fs_bt_leaf(struct fs_inode *dir, u32 hash) {
+    u32 blk = dir->dir.root;
+    int depth;
+    
+    for (depth = 0; depth < FS_BT_MAX_DEPTH; depth++) {
+        struct bcache_buf *b = fs_dir_bread(dir, blk);
+        struct fs_bt_node *node;
+    
+        if (b == NULL) {
+            return 0;
+        }
+        node = (struct fs_bt_node *)b->data;
+        if (node->magic != FS_BT_MAGIC) {
+            bcache_release(b);
+            return 0;
+        }
+        if (node->leaf) {
+            bcache_release(b);
+            return blk;
+        }
+        blk = node->val[fs_bt_search(node, hash, 0)];
+        bcache_release(b);
+    }
+    return 0;
+}
+
+/*
+ * Buscar un nombre en un directorio: desde la hoja más a la izquierda
+ * con su hash se recorren las claves iguales (las colisiones pueden
+ * seguir en las hojas siguientes). Devuelve la entrada, copiada en
+ * *entry, o FS_NO_SLOT.
+ */
+static u32 fs_dir_lookup(struct fs_inode *dir, const char *name, u32 hash, struct file_entry *entry) {
+    u32 blk = fs_bt_leaf(dir, hash);
+    
+    while (blk) {
+        struct bcache_buf *b = fs_dir_bread(dir, blk);
+        struct fs_bt_node *node;
+        u32 i;
+    
+        if (b == NULL) {
+            break;
+        }
+        node = (struct fs_bt_node *)b->data;
+        for (i = fs_bt_search(node, hash, 0); i < node->count; i++) {
+            if (node->key[i] != hash) {
+                bcache_release(b);
+                return FS_NO_SLOT;
+            }
+            if (fs_slot_read(dir, node->val[i], entry) == 0 && entry->used &&
+                fs_name_equal(entry->name, name)) {
+                u32 slot = node->val[i];
+    
+                bcache_release(b);
+                return slot;
+            }
+        }
+        blk = node->next;
+        bcache_release(b);
+    }
+    return FS_NO_SLOT;
+}
+
+/*
+ * Meter (hash, val) en la posición i de un nodo retenido. Si está lleno
+ * se reparte con un nodo nuevo a su derecha y se devuelve 1 con la clave
+ * que sube en *sep y el nodo nuevo en *right.
+ */
+static int fs_bt_node_insert(struct fs_inode *dir, struct bcache_buf *b, u32 i,
+                             u32 hash, u32 val, u32 *sep, u32 *right) {
+    struct fs_bt_node *node = (struct fs_bt_node *)b->data;
+    u32 max = node->leaf ? FS_BT_ORDER : FS_BT_ORDER - 1;
+    u32 vi = node->leaf ? i : i + 1;
+    u32 nvals = node->leaf ? node->count : node->count + 1;
+    u32 keys[FS_BT_ORDER + 1];
+    u32 vals[FS_BT_ORDER + 1];
+    u32 k;
+    
+    if (node->count < max) {
+        for (k = node->count; k > i; k--) {
+            node->key[k] = node->key[k - 1];
+        }
+        for (k = nvals; k > vi; k--) {
+            node->val[k] = node->val[k - 1];
+        }
+        node->key[i] = hash;
+        node->val[vi] = val;
+        node->count++;
+        bcache_mark_dirty(b);
+        journal_dirty(b);
+        return 0;
+    }
+    
+    // Lleno: repartir las claves con un nodo nuevo
+    u32 nb = fs_dir_alloc_block(dir);
+    struct bcache_buf *rb = nb ? fs_dir_bget(dir, nb) : NULL;
+    if (rb == NULL) {
+        bcache_release(b);
+        return -1;
+    }
+    
+    for (k = 0; k <= node->count; k++) {
+        keys[k] = (k < i) ? node->key[k] : (k == i) ? hash : node->key[k - 1];
+    }
+    for (k = 0; k <= nvals; k++) {
+        vals[k] = (k < vi) ? node->val[k] : (k == vi) ? val : node->val[k - 1];
+    }
+    
+    struct fs_bt_node *rn = (struct fs_bt_node *)rb->data;
+    u32 total = node->count + 1;
+    u32 half = total / 2;
+    
+    memset(rb->data, 0, SECTOR_SIZE);
+    rn->magic = FS_BT_MAGIC;
+    rn->leaf = node->leaf;
+    
+    if (node->leaf) {
+        // Hojas: la primera clave de la derecha hace de separador
+        node->count = half;
+        rn->count = total - half;
+        for (k = 0; k < rn->count; k++) {
+            rn->key[k] = keys[half + k];
+            rn->val[k] = vals[half + k];
+        }
+        for (k = 0; k < half; k++) {
+            node->key[k] = keys[k];
+            node->val[k] = vals[k];
+        }
+        rn->next = node->next;
+        node->next = nb;
+    } else {
+        // Internos: la clave del medio sube al padre
+        node->count = half;
+        rn->count = total - half - 1;
+        for (k = 0; k < rn->count; k++) {
+            rn->key[k] = keys[half + 1 + k];
+        }
+        for (k = 0; k <= rn->count; k++) {
+            rn->val[k] = vals[half + 1 + k];
+        }
+        for (k = 0; k < half; k++) {
+            node->key[k] = keys[k];
+        }
+        for (k = 0; k <= half; k++) {
+            node->val[k] = vals[k];
+        }
+    }
+    *sep = keys[half];
+    *right = nb;
+    
+    bcache_mark_dirty(b);
+    journal_dirty(b);
+    bcache_mark_dirty(rb);
+    journal_dirty(rb);
+    return 1;
+}
+
+/* Insertar bajo el nodo 'blk': 0, -1 o 1 si se ha partido (ver arriba) */
+static int fs_bt_insert_at(struct fs_inode *dir, u32 blk, u32 hash, u32 val, int depth,
+                           u32 *sep, u32 *right) {
+    struct bcache_buf *b = fs_dir_bread(dir, blk);
+    struct fs_bt_node *node;
+    u32 i;
+    
+    if (b == NULL) {
+        return -1;
+    }
+    node = (struct fs_bt_node *)b->data;
+    if (node->magic != FS_BT_MAGIC || depth >= FS_BT_MAX_DEPTH) {
+        bcache_release(b);
+        return -1;
+    }
+    
+    // Detrás de las claves iguales: el orden de inserción se conserva
+    i = fs_bt_search(node, hash, 1);
+    if (!node->leaf) {
+        int split = fs_bt_insert_at(dir, node->val[i], hash, val, depth + 1, &hash, &val);
+    
+        if (split <= 0) {
+            bcache_release(b);
+            return split;
+        }
+    }
+    return fs_bt_node_insert(dir, b, i, hash, val, sep, right);
+}
+
+/* Indexar la entrada 'slot' con el hash de su nombre */
+static int fs_bt_insert(struct fs_inode *dir, u32 hash, u32 slot) {
+    struct bcache_buf *b;
+    struct fs_bt_node *node;
+    u32 sep, right, nb;
+    int split = fs_bt_insert_at(dir, dir->dir.root, hash, slot, 0, &sep, &right);
+    
+    if (split <= 0) {
+        return split;
+    }
+    
+    // Se ha partido la raíz: una nueva con los dos nodos como hijos
+    nb = fs_dir_alloc_block(dir);
+    b = nb ? fs_dir_bget(dir, nb) : NULL;
+    if (b == NULL) {
+        return -1;
+    }
+    memset(b->data, 0, SECTOR_SIZE);
+    node = (struct fs_bt_node *)b->data;
+    node->magic = FS_BT_MAGIC;
+    node->count = 1;
+    node->key[0] = sep;
+    node->val[0] = dir->dir.root;
+    node->val[1] = right;
+    bcache_mark_dirty(b);
+    journal_dirty(b);
+    
+    dir->dir.root = nb;
+    return 0;
+}
+
+/* Quitar del árbol la clave de la entrada 'slot' (las hojas no se fusionan) */
+static int fs_bt_remove(struct fs_inode *dir, u32 hash, u32 slot) {
+    u32 blk = fs_bt_leaf(dir, hash);
+    
+    while (blk) {
+        struct bcache_buf *b = fs_dir_bread(dir, blk);
+        struct fs_bt_node *node;
+        u32 i, k;
+    
+        if (b == NULL) {
+            break;
+        }
+        node = (struct fs_bt_node *)b->data;
+        for (i = fs_bt_search(node, hash, 0); i < node->count && node->key[i] == hash; i++) {
+            if (node->val[i] == slot) {
+                for (k = i; k + 1 < node->count; k++) {
+                    node->key[k] = node->key[k + 1];
+                    node->val[k] = node->val[k + 1];
+                }
+                node->count--;
+                bcache_mark_dirty(b);
+                journal_dirty(b);
+                return 0;
+            }
+        }
+        if (i < node->count) {
+            bcache_release(b);
+            break;
+        }
+        blk = node->next;
+        bcache_release(b);
+    }
+    return -1;
+}
+
+static u32 fs_dhashfn(struct fs_inode *dir, u32 hash) {
+    return (hash ^ ((u32)dir >> 4)) & (FS_DCACHE_HASH - 1);
+}
+
+static void fs_dlru_remove(struct fs_dentry *d) {
+    if (d->lru_prev) d->lru_prev->lru_next = d->lru_next;
+    else fs_dlru_head = d->lru_next;
+    if (d->lru_next) d->lru_next->lru_prev = d->lru_prev;
+    else fs_dlru_tail = d->lru_prev;
+}
+
+static void fs_dlru_push_front(struct fs_dentry *d) {
+    d->lru_prev = NULL;
+    d->lru_next = fs_dlru_head;
+    if (fs_dlru_head) fs_dlru_head->lru_prev = d;
+    fs_dlru_head = d;
+    if (fs_dlru_tail == NULL) fs_dlru_tail = d;
+}
+
+/* Sacar una dentry de la tabla y dejarla libre al final de la LRU */
+static void fs_dentry_free(struct fs_dentry *d) {
+    struct fs_dentry **pp = &fs_dhash[fs_dhashfn(d->dir, d->hash)];
+    
+    while (*pp && *pp != d) {
+        pp = &(*pp)->hash_next;
+    }
+    if (*pp) {
+        *pp = d->hash_next;
+    }
+    d->hash_next = NULL;
+    d->dir = NULL;
+    
+    fs_dlru_remove(d);
+    d->lru_prev = fs_dlru_tail;
+    d->lru_next = NULL;
+    if (fs_dlru_tail) fs_dlru_tail->lru_next = d;
+    fs_dlru_tail = d;
+    if (fs_dlru_head == NULL) fs_dlru_head = d;
+}
+
+/* Vaciar la caché de nombres (al montar) */
+static void fs_dcache_init(void) {
+    int i;
+    
+    memset(fs_dentries, 0, sizeof(fs_dentries));
+    memset(fs_dhash, 0, sizeof(fs_dhash));
+    memset(&fs_dcache_stats, 0, sizeof(fs_dcache_stats));
+    fs_dlru_head = NULL;
+    fs_dlru_tail = NULL;
+    for (i = 0; i < FS_DCACHE_SIZE; i++) {
+        fs_dlru_push_front(&fs_dentries[i]);
+    }
+}
+
+/* Dentry de 'name' en 'dir', si está en la caché */
+static struct fs_dentry *fs_dcache_find(struct fs_inode *dir, const char *name, u32 hash) {
+    struct fs_dentry *d;
+    
+    for (d = fs_dhash[fs_dhashfn(dir, hash)]; d; d = d->hash_next) {
+        if (d->dir == dir && d->hash == hash && fs_name_equal(d->name, name)) {
+            fs_dlru_remove(d);
+            fs_dlru_push_front(d);
+            return d;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Recordar que 'name' está en la entrada 'slot' de 'dir' (o que no
+ * existe, con FS_NO_SLOT). Crear y borrar la actualizan en el sitio.
+ */
+static void fs_dcache_set(struct fs_inode *dir, const char *name, u32 hash, u32 slot) {
+    struct fs_dentry *d = fs_dcache_find(dir, name, hash);
+    u32 len;
+    
+    if (d == NULL) {
+        // La menos usada; las libres están siempre al final
+        d = fs_dlru_tail;
+        if (d->dir) {
+            fs_dcache_stats.evictions++;
+            fs_dentry_free(d);
+        }
+        len = strlen(name);
+        if (len >= MAX_FILENAME) {
+            len = MAX_FILENAME - 1;
+        }
+        memcpy(d->name, name, len);
+        d->name[len] = '\0';
+        d->dir = dir;
+        d->hash = hash;
+        d->hash_next = fs_dhash[fs_dhashfn(dir, hash)];
+        fs_dhash[fs_dhashfn(dir, hash)] = d;
+        fs_dlru_remove(d);
+        fs_dlru_push_front(d);
+    }
+    d->slot = slot;
+}
+
+/* Olvidar los nombres de un directorio que sale de memoria */
+static void fs_dcache_purge(struct fs_inode *dir) {
+    int i;
+    
+    for (i = 0; i < FS_DCACHE_SIZE; i++) {
+        if (fs_dentries[i].dir == dir) {
+            fs_dentry_free(&fs_dentries[i]);
+        }
+    }
+}
+
+/* Inodo en memoria de la entrada 'slot' de 'dir', si lo hay */
+static struct fs_inode *fs_icached(struct fs_inode *dir, u32 slot) {
+    int i;
+    
+    for (i = 1; i < FS_INODES; i++) {
+        if (fs_inodes[i].used && fs_inodes[i].parent == dir && fs_inodes[i].slot == slot) {
+            return &fs_inodes[i];
+        }
+    }
+    return NULL;
+}
+
+/* Sacar de memoria un inodo sin referencias */
+static void fs_inode_drop(struct fs_inode *ino) {
+    // Con un trozo sin escribir no llega aquí (fs_iget no lo elige) salvo
+    // al borrar el archivo, que lo descarta antes
+    if (fs_zino == ino && !fs_zdirty) {
+        fs_zino = NULL;
+    }
+    if (ino->entry.type == FILE_TYPE_DIRECTORY) {
+        fs_dcache_purge(ino);
+    }
+    if (ino->parent) {
+        ino->parent->refs--;
+    }
+    ino->used = 0;
+}
+
+/*
+ * Inodo de la entrada 'slot' de 'dir', ya leída en *entry: el que está en
+ * memoria o uno nuevo en un hueco libre o en el más antiguo que nadie
+ * referencia. Devuelve el inodo con una referencia.
+ */
+static struct fs_inode *fs_iget(struct fs_inode *dir, u32 slot, const struct file_entry *entry) {
+    struct fs_inode *ino = fs_icached(dir, slot);
+    int i;
+    
+    if (ino == NULL) {
+        for (i = 1; i < FS_INODES; i++) {
+            struct fs_inode *cand = &fs_inodes[i];
+    
+            if (!cand->used) {
+                ino = cand;
+                break;
+            }
+            // El del trozo comprimido sin escribir sigue retenido para fs_sync
+            if (cand->refs == 0 && !(cand == fs_zino && fs_zdirty) &&
+                (ino == NULL || cand->stamp < ino->stamp)) {
+                ino = cand;
+            }
+        }
+        if (ino == NULL) {
+            print("fs     : ERROR - Too many files in use\n");
+            return NULL;
+        }
+        if (ino->used) {
+            fs_inode_drop(ino);
+        }
+    
+        memset(ino, 0, sizeof(struct fs_inode));
+        ino->entry = *entry;
+        ino->parent = dir;
+        ino->slot = slot;
+        if (entry->type == FILE_TYPE_DIRECTORY && fs_dir_read_header(ino) != 0) {
+            return NULL;
+        }
+        ino->used = 1;
+        dir->refs++;
+    }
+    
+    ino->refs++;
+    ino->stamp = ++fs_clock;
+    return ino;
+}
+
+/* Soltar una referencia de fs_iget() o fs_namei() */
+static void fs_iput(struct fs_inode *ino) {
+    if (ino->refs > 0) {
+        ino->refs--;
+    }
+}
+
+/*
+ * Buscar 'name' en 'dir' pasando por la caché de nombres: un acierto no
+ * recorre el árbol, y uno negativo no lee nada. Devuelve la entrada,
+ * copiada en *entry, o FS_NO_SLOT.
+ */
+static u32 fs_lookup(struct fs_inode *dir, const char *name, struct file_entry *entry) {
+    u32 hash = fs_name_hash(name);
+    struct fs_dentry *d = fs_dcache_find(dir, name, hash);
+    struct fs_inode *ino;
+    u32 slot;
+    
+    if (d && d->slot == FS_NO_SLOT) {
+        fs_dcache_stats.negative++;
+        return FS_NO_SLOT;
+    }
+    if (d) {
+        fs_dcache_stats.hits++;
+        ino = fs_icached(dir, d->slot);
+        if (ino) {
+            *entry = ino->entry;
+            return d->slot;
+        }
+        return (fs_slot_read(dir, d->slot, entry) == 0) ? d->slot : FS_NO_SLOT;
+    }
+    
+    fs_dcache_stats.misses++;
+    slot = fs_dir_lookup(dir, name, hash, entry);
+    fs_dcache_set(dir, name, hash, slot);
+    return slot;
+}
+
+/* Un paso de la ruta: 'name' dentro de 'dir' (referenciado) */
+static struct fs_inode *fs_step(struct fs_inode *dir, const char *name) {
+    struct file_entry entry;
+    u32 slot;
+    
+    if (dir->entry.type != FILE_TYPE_DIRECTORY) {
+        return NULL;
+    }
+    if (strcmp(name, ".") == 0 || (strcmp(name, "..") == 0 && dir->parent == NULL)) {
+        dir->refs++;
+        return dir;
+    }
+    if (strcmp(name, "..") == 0) {
+        dir->parent->refs++;
+        return dir->parent;
+    }
+    
+    slot = fs_lookup(dir, name, &entry);
+    if (slot == FS_NO_SLOT) {
+        return NULL;
+    }
+    return fs_iget(dir, slot, &entry);
+}
+
+/*
+ * Resolver una ruta desde la raíz ("/a/b" o "a/b"; valen "." y "..").
+ * Devuelve el inodo con una referencia (soltarla con fs_iput) o NULL.
+ * Con 'last' se para en el directorio padre y copia ahí el último
+ * componente, truncado a MAX_FILENAME - 1.
+ */
+static struct fs_inode *fs_namei(const char *path, char *last) {
+    struct fs_inode *cur = fs_root;
+    char name[MAX_FILENAME];
+    const char *p = path;
+    
+    if (fs_dev == NULL || path == NULL) {
+        return NULL;
+    }
+    cur->refs++;
+    
+    for (;;) {
+        u32 len = 0;
+    
+        while (*p == '/') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        while (*p && *p != '/') {
+            if (len < MAX_FILENAME - 1) {
+                name[len++] = *p;
+            }
+            p++;
+        }
+        name[len] = '\0';
+    
+        // Último componente: lo resuelve el llamador
+        const char *rest = p;
+        while (*rest == '/') {
+            rest++;
+        }
+        if (last && *rest == '\0') {
+            memcpy(last, name, len + 1);
+            return cur;
+        }
+    
+        struct fs_inode *next = fs_step(cur, name);
+        fs_iput(cur);
+        if (next == NULL) {
+            return NULL;
+        }
+        cur = next;
+    }
+    
+    // Sin último componente ("/", "a/.."): nada que crear o borrar
+    if (last) {
+        fs_iput(cur);
+        return NULL;
+    }
+    return cur;
+}
+
+/* Crear un sistema de archivos vacío en fs_dev */
+static int fs_format(void) {
+    u32 total = fs_dev->sectors;
+    u32 bitmap_bytes;
+    
+    if (total > FS_MAX_SECTORS) {
+        total = FS_MAX_SECTORS;
+    }
+    
+    memset(&fs_sb, 0, sizeof(struct fs_superblock));
+    fs_sb.magic = FS_MAGIC;
+    fs_sb.version = FS_VERSION;
+    fs_sb.total_sectors = total;
+    fs_sb.bitmap_start = FS_SUPERBLOCK_SECTOR + 1;
+    fs_sb.bitmap_sectors = (total + FS_BITS_PER_SECTOR - 1) / FS_BITS_PER_SECTOR;
+    fs_sb.journal_start = fs_sb.bitmap_start + fs_sb.bitmap_sectors;
+    fs_sb.journal_sectors = FS_JOURNAL_SECTORS;
+    fs_sb.data_start = fs_sb.journal_start + fs_sb.journal_sectors;
+    
+    if (fs_sb.data_start >= total) {
+        print("fs     : ERROR - Device too small\n");
+        return -1;
+    }
+    
+    bitmap_bytes = fs_sb.bitmap_sectors * SECTOR_SIZE;
+    fs_bitmap = (u32 *)kmalloc(bitmap_bytes);
+    if (fs_bitmap == NULL) {
+        print("fs     : ERROR - Cannot allocate free-space bitmap\n");
+        return -1;
+    }
+    
+    // Metadatos y bits más allá del final: siempre ocupados
+    memset(fs_bitmap, 0, bitmap_bytes);
+    fs_bits_set(0, fs_sb.data_start, 1);
+    fs_bits_set(total, bitmap_bytes * 8 - total, 1);
+    fs_sb.free_sectors = total - fs_sb.data_start;
+    
+    if (blockdev_write(fs_dev, fs_sb.bitmap_start, fs_sb.bitmap_sectors, fs_bitmap) != 0) {
+        print("fs     : ERROR - Cannot write free-space bitmap\n");
+        return -1;
+    }
+    if (journal_format(fs_dev, fs_sb.journal_start, fs_sb.journal_sectors) != 0) {
+        print("fs     : ERROR - Cannot create journal\n");
+        return -1;
+    }
+    
+    // Directorio raíz vacío al principio de la zona de datos
+    memset(fs_root, 0, sizeof(struct fs_inode));
+    fs_root->entry.type = FILE_TYPE_DIRECTORY;
+    fs_root->entry.used = 1;
+    fs_root->used = 1;
+    if (fs_dir_init(fs_root) != 0) {
+        print("fs     : ERROR - Cannot create root directory\n");
+        return -1;
+    }
+    fs_inode_write(fs_root);
+    return 0;
+}
+
+/* Leer el superbloque (a través de la caché) */
+static int fs_read_super(void) {
+    struct bcache_buf *b = bcache_read(fs_dev, FS_SUPERBLOCK_SECTOR);
+    
+    if (b == NULL) {
+        return -1;
+    }
+    memcpy(&fs_sb, b->data, sizeof(struct fs_superblock));
+    bcache_release(b);
+    return 0;
+}
+
+/*
+ * Leer superbloque y bitmap; -1 si el disco no tiene un fs válido. Antes
+ * se reproduce el diario: puede cambiar cualquier bloque de metadatos.
+ */
+static int fs_mount(void) {
+    int replayed;
+    
+    if (fs_read_super() != 0 || fs_sb.magic != FS_MAGIC || fs_sb.version != FS_VERSION) {
+        return -1;
+    }
+    
+    replayed = journal_replay(fs_dev, fs_sb.journal_start, fs_sb.journal_sectors);
+    if (replayed < 0) {
+        print("fs     : ERROR - Bad journal\n");
+        return -1;
+    }
+    if (replayed > 0) {
+        print("fs     : Replayed ");
+        print_dec(replayed);
+        print(" journal transactions\n");
+        if (fs_read_super() != 0) {
+            return -1;
+        }
+    }
+    
+    if (fs_sb.magic != FS_MAGIC || fs_sb.version != FS_VERSION ||
+        fs_sb.total_sectors > fs_dev->sectors || fs_sb.total_sectors > FS_MAX_SECTORS ||
+        fs_sb.bitmap_sectors != (fs_sb.total_sectors + FS_BITS_PER_SECTOR - 1) / FS_BITS_PER_SECTOR ||
+        fs_sb.data_start >= fs_sb.total_sectors ||
+        fs_sb.journal_start + fs_sb.journal_sectors > fs_sb.data_start ||
+        fs_sb.root.type != FILE_TYPE_DIRECTORY || fs_sb.root.nextents > FS_MAX_EXTENTS ||
+        fs_sb.root.size < 2 * SECTOR_SIZE ||
+        fs_sb.root.size % SECTOR_SIZE != 0 ||
+        fs_sb.root.size / SECTOR_SIZE > fs_file_sectors(&fs_sb.root)) {
+        return -1;
+    }
+    
+    fs_bitmap = (u32 *)kmalloc(fs_sb.bitmap_sectors * SECTOR_SIZE);
+    if (fs_bitmap == NULL) {
+        print("fs     : ERROR - Cannot allocate free-space bitmap\n");
+        return -1;
+    }
+    memset(fs_root, 0, sizeof(struct fs_inode));
+    fs_root->entry = fs_sb.root;
+    fs_root->used = 1;
+    if (blockdev_read(fs_dev, fs_sb.bitmap_start, fs_sb.bitmap_sectors, fs_bitmap) != 0 ||
+        fs_dir_read_header(fs_root) != 0) {
+        kfree(fs_bitmap);
+        fs_bitmap = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Inicializar el sistema de archivos */
+void fs_init(void) {
+    int i;
+    
+    // Ningún archivo en memoria
+    memset(fs_inodes, 0, sizeof(fs_inodes));
+    fs_dcache_init();
+    fs_zino = NULL;
+    memset(&fs_zstats, 0, sizeof(fs_zstats));
+    
+    // Limpiar descriptores de archivos
+    for (i = 0; i < MAX_FILES; i++) {
+        open_files[i].used = 0;
+        open_files[i].entry = NULL;
+        open_files[i].position = 0;
+    }
+    
+    // Usar el disco IDE master si existe; si no, el primer dispositivo
+    fs_dev = blockdev_find(FS_DEFAULT_DEVICE);
+    if (fs_dev == NULL) {
+        fs_dev = blockdev_get(0);
+    }
+    if (fs_dev == NULL) {
+        print("fs     : ERROR - No block device available\n");
+        return;
+    }
+    print("fs     : Using block device ");
+    print(fs_dev->name);
+    print("\n");
+    
+    // Montar el sistema de archivos del disco o crear uno nuevo
+    if (fs_mount() == 0) {
+        print("fs     : Loaded existing filesystem (");
+        print_dec(fs_sb.free_sectors / 2);
+        print("KB free)\n");
+        return;
+    }
+    
+    print("fs     : Creating new filesystem\n");
+    if (fs_format() != 0) {
+        fs_dev = NULL;
+        return;
+    }
+    
+    // Crear algunos archivos de ejemplo
+    fs_create_file("readme.txt", 0);
+    fs_create_file("welcome.txt", 0);
+}
+
+/* Sectores de un archivo comprimido de 'size' bytes: índice y huecos */
+static u32 fs_zsectors(u32 size) {
+    return 1 + (size + FS_ZCHUNK - 1) / FS_ZCHUNK * FS_ZCHUNK_SECTORS;
+}
+
+/* E/S directa de 'count' sectores desde el sector 'rel' de un archivo */
+static int fs_file_io(struct file_entry *file, u32 rel, u32 count, u8 *buf, int write) {
+    while (count > 0) {
+        u32 run;
+        u32 lba = fs_bmap(file, rel, &run);
+        
+        if (lba == 0) {
+            return -1;
+        }
+        if (run > count) run = count;
+        if ((write ? bcache_write_direct(fs_dev, lba, run, buf)
+                   : bcache_read_direct(fs_dev, lba, run, buf)) != 0) {
+            return -1;
+        }
+        rel += run;
+        count -= run;
+        buf += run * SECTOR_SIZE;
+    }
+    return 0;
+}
+
+/*
+ * Comprimir fs_zdata y escribirlo como trozo 'idx' de un archivo. Si
+ * comprimido no ahorra al menos un sector se guarda tal cual (longitud
+ * FS_ZCHUNK). Con 'journaled' los sectores van por la caché y el diario
+ * (dentro de una operación ya empezada); si no, directos. Devuelve la
+ * longitud para el índice o 0 si falla.
+ */
+static u32 fs_zput(struct file_entry *file, u32 idx, int journaled) {
+    u8 *src = fs_zbuf;
+    u32 zlen, nsec, i;
+    u64 t0;
+    
+    t0 = cpu_cycles();
+    zlen = lz_compress(fs_zdata, FS_ZCHUNK, fs_zbuf, FS_ZCHUNK - SECTOR_SIZE);
+    fs_zstats.compress_cycles += cpu_cycles() - t0;
+    
+    if (zlen == 0) {
+        zlen = FS_ZCHUNK;
+        src = fs_zdata;
+        fs_zstats.raw_chunks++;
+    }
+    nsec = (zlen + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    memset(src + zlen, 0, nsec * SECTOR_SIZE - zlen);
+    if (!journaled) {
+        if (fs_file_io(file, 1 + idx * FS_ZCHUNK_SECTORS, nsec, src, 1) != 0) {
+            print("fs     : ERROR - Cannot write compressed chunk\n");
+            return 0;
+        }
+    } else {
+        for (i = 0; i < nsec; i++) {
+            u32 lba = fs_bmap(file, 1 + idx * FS_ZCHUNK_SECTORS + i, NULL);
+            struct bcache_buf *b = lba ? bcache_get(fs_dev, lba) : NULL;
+            
+            if (b == NULL) {
+                print("fs     : ERROR - Cannot write compressed chunk\n");
+                return 0;
+            }
+            memcpy(b->data, src + i * SECTOR_SIZE, SECTOR_SIZE);
+            bcache_mark_dirty(b);
+            journal_dirty(b);
+        }
+    }
+    
+    fs_zstats.chunks_written++;
+    fs_zstats.bytes_in += FS_ZCHUNK;
+    fs_zstats.bytes_out += zlen;
+    return zlen;
+}
 
-/* Inicializar el sistema de archivos */
-void fs_init(void) {
-    int i;
+/*
+ * Guardar el trozo en memoria si ha cambiado. La primera vez los datos
+ * van directos a un hueco al que el índice aún no apunta, y el índice
+ * después, por el diario. Un trozo ya escrito se reescribe en su sitio,
+ * así que va por el diario en la misma operación que su nueva longitud:
+ * tras un corte nunca quedan la longitud vieja y los datos nuevos.
+ */
+static int fs_zflush(void) {
+    struct file_entry *file;
+    struct bcache_buf *b;
+    u32 zlen, old;
     
-    // Limpiar la estructura del directorio raíz
-    memset(&root_dir, 0, sizeof(struct directory));
+    if (fs_zino == NULL || !fs_zdirty) {
+        return 0;
+    }
+    file = &fs_zino->entry;
     
-    // Limpiar descriptores de archivos
-    for (i = 0; i < MAX_FILES; i++) {
-        open_files[i].used = 0;
-        open_files[i].entry = NULL;
-        open_files[i].position = 0;
+    b = bcache_read(fs_dev, file->extents[0].start);
+    if (b == NULL) {
+        return -1;
     }
+    old = ((u16 *)b->data)[fs_zidx];
+    bcache_release(b);
     
-    // Initialize shared buffer
-    sector_buffer_in_use = 0;
+    if (old == 0) {
+        zlen = fs_zput(file, fs_zidx, 0);
+        journal_begin();
+    } else {
+        journal_begin();
+        zlen = fs_zput(file, fs_zidx, 1);
+    }
+    if (zlen == 0) {
+        return -1;
+    }
     
-    // Intentar cargar el directorio raíz desde el disco
-    if (ide_read_sectors(IDE_MASTER, 1, 1, &root_dir) != 0) {
-        print("fs     : Creating new filesystem\n");
-        
-        // Crear algunos archivos de ejemplo
-        fs_create_file("readme.txt", 100);
-        fs_create_file("welcome.txt", 200);
-        
-        // Guardar el directorio raíz en el disco
-        ide_write_sectors(IDE_MASTER, 1, 1, &root_dir);
+    b = bcache_read(fs_dev, file->extents[0].start);
+    if (b == NULL) {
+        return -1;
+    }
+    ((u16 *)b->data)[fs_zidx] = zlen;
+    bcache_mark_dirty(b);
+    journal_dirty(b);
+    
+    fs_zdirty = 0;
+    return 0;
+}
+
+/*
+ * Dejar en memoria el trozo 'idx' de un archivo comprimido. Con 'whole'
+ * el llamador lo va a sobrescribir entero y no hace falta leerlo.
+ */
+static int fs_zload(struct fs_inode *ino, u32 idx, int whole) {
+    struct file_entry *file = &ino->entry;
+    struct bcache_buf *b;
+    u32 zlen = 0;
+    u32 nsec;
+    u64 t0;
+    
+    if (fs_zino == ino && fs_zidx == idx) {
+        return 0;
+    }
+    if (fs_zflush() != 0) {
+        return -1;
+    }
+    fs_zino = NULL;
+    
+    if (!whole) {
+        b = bcache_read(fs_dev, file->extents[0].start);
+        if (b == NULL) {
+            return -1;
+        }
+        zlen = ((u16 *)b->data)[idx];
+        bcache_release(b);
+    }
+    
+    // 0: nunca escrito (ceros); FS_ZCHUNK: guardado sin comprimir
+    nsec = (zlen + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (zlen == 0) {
+        memset(fs_zdata, 0, FS_ZCHUNK);
+    } else if (zlen > FS_ZCHUNK) {
+        return -1;
+    } else if (zlen == FS_ZCHUNK) {
+        if (fs_file_io(file, 1 + idx * FS_ZCHUNK_SECTORS, nsec, fs_zdata, 0) != 0) {
+            return -1;
+        }
     } else {
-        print("fs     : Loaded existing filesystem\n");
+        if (fs_file_io(file, 1 + idx * FS_ZCHUNK_SECTORS, nsec, fs_zbuf, 0) != 0) {
+            return -1;
+        }
+        t0 = cpu_cycles();
+        if (lz_decompress(fs_zbuf, zlen, fs_zdata, FS_ZCHUNK) != FS_ZCHUNK) {
+            print("fs     : ERROR - Corrupt compressed chunk\n");
+            return -1;
+        }
+        fs_zstats.decompress_cycles += cpu_cycles() - t0;
+    }
+    if (zlen) {
+        fs_zstats.chunks_read++;
+        fs_zstats.sectors_read += nsec;
+        fs_zstats.sectors_saved += FS_ZCHUNK_SECTORS - nsec;
     }
+    
+    fs_zino = ino;
+    fs_zidx = idx;
+    fs_zdirty = 0;
+    return 0;
 }
 
-/* Helper function to get sector buffer */
-static char *get_sector_buffer(void) {
-    if (sector_buffer_in_use) {
-        // Fallback to dynamic allocation if buffer is in use
-        return (char *)kmalloc(SECTOR_SIZE);
+/*
+ * Leer de un archivo comprimido, trozo a trozo: al buffer o, si es NULL,
+ * a 'output_func' en tramos.
+ */
+static int fs_zread(struct file_descriptor *file_desc, u8 *dest, u32 size,
+                    void (*output_func)(const char *buf, u32 len)) {
+    u32 done = 0;
+    
+    while (done < size) {
+        u32 idx = file_desc->position / FS_ZCHUNK;
+        u32 offset = file_desc->position % FS_ZCHUNK;
+        u32 n = FS_ZCHUNK - offset;
+        if (n > size - done) n = size - done;
+        
+        if (fs_zload(file_desc->inode, idx, 0) != 0) {
+            return done ? (int)done : -1;
+        }
+        if (dest) {
+            memcpy(dest + done, fs_zdata + offset, n);
+        } else {
+            output_func((const char *)fs_zdata + offset, n);
+        }
+        file_desc->position += n;
+        done += n;
     }
-    sector_buffer_in_use = 1;
-    return sector_buffer;
+    
+    file_desc->ra_prev_end = file_desc->position;
+    return done;
 }
 
-/* Helper function to release sector buffer */
-static void release_sector_buffer(char *buffer) {
-    if (buffer == sector_buffer) {
-        sector_buffer_in_use = 0;
-    } else {
-        kfree(buffer);
+/*
+ * Escribir en un archivo comprimido: los datos van al trozo en memoria y
+ * se comprimen al cambiar de trozo, al cerrar o en fs_sync().
+ */
+static int fs_zwrite(struct file_descriptor *file_desc, const u8 *src, u32 size) {
+    struct file_entry *file = file_desc->entry;
+    u32 end = file_desc->position + size;
+    u32 done = 0;
+    
+    if (end > FS_ZCHUNKS_MAX * FS_ZCHUNK) {
+        return -1;          // Demasiado grande para el índice
     }
+    if (end > file->size && fs_grow_steps(file_desc->inode, fs_zsectors(end) * SECTOR_SIZE) != 0) {
+        return -1;
+    }
+    
+    while (done < size) {
+        u32 idx = file_desc->position / FS_ZCHUNK;
+        u32 offset = file_desc->position % FS_ZCHUNK;
+        u32 n = FS_ZCHUNK - offset;
+        if (n > size - done) n = size - done;
+        
+        if (fs_zload(file_desc->inode, idx, n == FS_ZCHUNK) != 0) {
+            break;
+        }
+        memcpy(fs_zdata + offset, src + done, n);
+        fs_zdirty = 1;
+        file_desc->position += n;
+        done += n;
+    }
+    
+    if (file_desc->position > file->size) {
+        journal_begin();
+        file->size = file_desc->position;
+        fs_inode_write(file_desc->inode);
+    }
+    return (done || size == 0) ? (int)done : -1;
 }
 
-/* Crear un archivo */
-int fs_create_file(const char *name, u32 size) {
-    int i;
+/*
+ * Crear un archivo o un directorio vacío. Devuelve 0, o -1 si ya existe,
+ * no existe el directorio padre o no hay espacio.
+ */
+static int fs_create(const char *path, u32 size, u8 type) {
+    char name[MAX_FILENAME];
+    struct file_entry entry;
+    struct fs_inode *dir = fs_namei(path, name);
+    u32 slot;
     
-    // Buscar si el archivo ya existe
-    if (fs_find_file(name) != NULL) {
+    if (dir == NULL) {
+        return -1;
+    }
+    if (dir->entry.type != FILE_TYPE_DIRECTORY || strcmp(name, ".") == 0 ||
+        strcmp(name, "..") == 0 || fs_lookup(dir, name, &entry) != FS_NO_SLOT) {
+        fs_iput(dir);
         return -1; // El archivo ya existe
     }
+    journal_begin();
     
-    // Buscar una entrada libre
-    for (i = 0; i < MAX_FILES; i++) {
-        if (!root_dir.files[i].used) {
-            // Copiar el nombre
-            u32 name_len = strlen(name);
-            if (name_len >= MAX_FILENAME) {
-                name_len = MAX_FILENAME - 1;
-            }
-            memcpy(root_dir.files[i].name, name, name_len);
-            root_dir.files[i].name[name_len] = '\0';
-            
-            // Configurar el archivo
-            root_dir.files[i].size = size;
-            root_dir.files[i].start_sector = next_free_sector;
-            root_dir.files[i].type = FILE_TYPE_REGULAR;
-            root_dir.files[i].used = 1;
-            
-            // Actualizar el sector libre
-            next_free_sector += (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
-            
-            root_dir.count++;
-            
-            // Guardar el directorio actualizado
-            ide_write_sectors(IDE_MASTER, 1, 1, &root_dir);
-            
-            return i;
+    // Sitio para la entrada y para partir el árbol hasta la raíz: a mitad
+    // de la inserción ya no puede faltar
+    if (fs_dir_reserve(dir, FS_DIR_RESERVE) != 0) {
+        fs_iput(dir);
+        return -1; // No hay espacio
+    }
+    
+    // Reservar el tamaño inicial (el archivo puede crecer después)
+    memset(&entry, 0, sizeof(struct file_entry));
+    if (type == FILE_TYPE_DIRECTORY) {
+        struct fs_inode tmp;
+    
+        memset(&tmp, 0, sizeof(struct fs_inode));
+        if (fs_dir_init(&tmp) != 0) {
+            fs_free_file(&tmp.entry);
+            fs_iput(dir);
+            return -1;
         }
+        entry = tmp.entry;
+    } else {
+        // Los pequeños no ocupan sectores: sus datos (a cero) van en la
+        // entrada. De los grandes aquí solo se reserva el primer tramo
+        u32 first = (size > FS_GROW_STEP * SECTOR_SIZE) ? FS_GROW_STEP * SECTOR_SIZE : size;
+    
+        if (size > FS_INLINE_MAX && fs_grow(&entry, first) != 0) {
+            fs_free_file(&entry);
+            fs_iput(dir);
+            return -1; // No hay espacio en disco
+        }
+        entry.size = first;
+    }
+    memcpy(entry.name, name, strlen(name) + 1);
+    entry.type = type;
+    entry.used = 1;
+    
+    slot = fs_slot_alloc(dir);
+    if (slot != FS_NO_SLOT && fs_bt_insert(dir, fs_name_hash(name), slot) != 0) {
+        fs_slot_free(dir, slot);
+        slot = FS_NO_SLOT;
+    }
+    if (slot == FS_NO_SLOT) {
+        fs_free_file(&entry);
+        fs_dir_write_header(dir);
+        fs_iput(dir);
+        return -1;
     }
     
-    return -1; // No hay espacio
+    // Solo cambian el bloque de la entrada, los nodos tocados y la cabecera
+    fs_slot_write(dir, slot, &entry);
+    fs_dcache_set(dir, name, fs_name_hash(name), slot);
+    dir->dir.count++;
+    fs_dir_write_header(dir);
+    
+    // El resto del tamaño pedido, en operaciones aparte
+    if (entry.size < size) {
+        struct fs_inode tmp;
+    
+        memset(&tmp, 0, sizeof(struct fs_inode));
+        tmp.entry = entry;
+        tmp.parent = dir;
+        tmp.slot = slot;
+        if (fs_grow_steps(&tmp, size) != 0) {
+            fs_iput(dir);
+            fs_delete_file(path);
+            return -1; // No hay espacio en disco
+        }
+        journal_begin();
+        tmp.entry.size = size;
+        fs_inode_write(&tmp);
+    }
+    fs_iput(dir);
+    return 0;
+}
+
+/* Crear un archivo */
+int fs_create_file(const char *path, u32 size) {
+    return fs_create(path, size, FILE_TYPE_REGULAR);
+}
+
+/* Crear un directorio */
+int fs_mkdir(const char *path) {
+    return fs_create(path, 0, FILE_TYPE_DIRECTORY);
 }
 
-/* Eliminar un archivo */
-int fs_delete_file(const char *name) {
-    struct file_entry *file = fs_find_file(name);
+/* Eliminar un archivo o un directorio vacío */
+int fs_delete_file(const char *path) {
+    char name[MAX_FILENAME];
+    struct file_entry entry;
+    struct fs_inode *dir = fs_namei(path, name);
+    struct fs_inode *ino;
+    u32 slot = FS_NO_SLOT;
     
-    if (file == NULL) {
+    if (dir == NULL) {
+        return -1;
+    }
+    if (dir->entry.type == FILE_TYPE_DIRECTORY) {
+        slot = fs_lookup(dir, name, &entry);
+    }
+    ino = (slot != FS_NO_SLOT) ? fs_iget(dir, slot, &entry) : NULL;
+    if (ino == NULL) {
+        fs_iput(dir);
         return -1; // Archivo no encontrado
     }
     
-    // Marcar como no usado
-    file->used = 0;
-    root_dir.count--;
+    // Ni abierto ni (si es un directorio) con algo dentro
+    if (ino->refs > 1 || (entry.type == FILE_TYPE_DIRECTORY && ino->dir.count > 0)) {
+        fs_iput(ino);
+        fs_iput(dir);
+        return -1;
+    }
+    entry = ino->entry;
+    if (fs_zino == ino) {
+        fs_zdirty = 0;      // sus datos ya no importan
+    }
+    fs_iput(ino);
+    fs_inode_drop(ino);
     
-    // Guardar el directorio actualizado
-    ide_write_sectors(IDE_MASTER, 1, 1, &root_dir);
+    // Sacarlo del índice, devolver la entrada y liberar su espacio: si es
+    // más de lo que cabe en una operación, después y por tramos
+    journal_begin();
+    fs_bt_remove(dir, fs_name_hash(name), slot);
+    fs_slot_free(dir, slot);
+    fs_dcache_set(dir, name, fs_name_hash(name), FS_NO_SLOT);
+    dir->dir.count--;
+    fs_dir_write_header(dir);
+    if (fs_file_sectors(&entry) <= FS_GROW_STEP) {
+        fs_free_file(&entry);
+    } else {
+        fs_free_file_steps(&entry);
+    }
+    fs_iput(dir);
     
     return 0;
 }
 
 /* Abrir un archivo */
-int fs_open_file(const char *name) {
-    struct file_entry *file = fs_find_file(name);
+int fs_open_file(const char *path) {
+    struct fs_inode *ino = fs_namei(path, NULL);
     int i;
     
-    if (file == NULL) {
+    if (ino == NULL) {
         return -1; // Archivo no encontrado
     }
+    if (ino->entry.type != FILE_TYPE_REGULAR) {
+        fs_iput(ino);
+        return -1;
+    }
     
-    // Buscar un descriptor libre
+    // Buscar un descriptor libre; se queda con la referencia del inodo
     for (i = 0; i < MAX_FILES; i++) {
         if (!open_files[i].used) {
-            open_files[i].entry = file;
+            open_files[i].entry = &ino->entry;
+            open_files[i].inode = ino;
             open_files[i].position = 0;
             open_files[i].used = 1;
+            open_files[i].ra_prev_end = 0;
+            open_files[i].ra_window = 0;
+            open_files[i].ra_end = 0;
             return i;
         }
     }
     
+    fs_iput(ino);
     return -1; // No hay descriptores disponibles
 }
 
 /* Cerrar un archivo */
 void fs_close_file(int fd) {
     if (fd >= 0 && fd < MAX_FILES && open_files[fd].used) {
+        // Si falla, el trozo sigue en memoria y fs_sync lo reintenta
+        if (fs_zino == open_files[fd].inode && fs_zflush() != 0) {
+            print("fs     : ERROR - Compressed data not written, kept for sync\n");
+        }
+        fs_iput(open_files[fd].inode);
         open_files[fd].used = 0;
         open_files[fd].entry = NULL;
+        open_files[fd].inode = NULL;
         open_files[fd].position = 0;
     }
 }
 
+/*
+ * Lectura anticipada adaptativa. Una lectura que empieza donde terminó la
+ * anterior duplica la ventana (hasta FS_RA_MAX); un salto la reduce a la
+ * mitad. Cuando la lectura se acerca a menos de media ventana del final
+ * de lo ya anticipado, se trae el siguiente tramo en un solo comando.
+ */
+static void fs_readahead(struct file_descriptor *file_desc, u32 size) {
+    struct file_entry *file = file_desc->entry;
+    u32 file_sectors = (file->size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    u32 first = file_desc->position / SECTOR_SIZE;
+    u32 need_end = (file_desc->position + size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    u32 start, end;
+    
+    if (file_desc->position == file_desc->ra_prev_end) {
+        if (file_desc->ra_window == 0) {
+            file_desc->ra_window = FS_RA_MIN;
+        } else if (file_desc->ra_window < FS_RA_MAX) {
+            file_desc->ra_window *= 2;
+        }
+    } else {
+        file_desc->ra_window /= 2;
+        file_desc->ra_end = 0;
+    }
+    
+    if (file_desc->ra_window == 0 || need_end + file_desc->ra_window / 2 <= file_desc->ra_end) {
+        return;
+    }
+    
+    start = (first > file_desc->ra_end) ? first : file_desc->ra_end;
+    end = need_end + file_desc->ra_window;
+    if (end > file_sectors) end = file_sectors;
+    
+    // Un comando por tramo contiguo en disco
+    while (start < end) {
+        u32 run;
+        u32 lba = fs_bmap(file, start, &run);
+        u32 n = end - start;
+        if (lba == 0) break;
+        if (n > run) n = run;
+        if (n > BCACHE_RA_MAX) n = BCACHE_RA_MAX;
+        bcache_readahead(fs_dev, lba, n);
+        start += n;
+    }
+    file_desc->ra_end = end;
+}
+
 /* Optimized read function that uses less memory */
 int fs_read_file(int fd, void *buffer, u32 size) {
     if (fd < 0 || fd >= MAX_FILES || !open_files[fd].used) {
@@ -172,30 +1824,66 @@ int fs_read_file(int fd, void *buffer, u32 size) {
         size = file->size - file_desc->position;
     }
     
-    // Leer desde el disco usando shared buffer
-    u32 sector = file->start_sector + (file_desc->position / SECTOR_SIZE);
-    u32 offset = file_desc->position % SECTOR_SIZE;
-    
-    char *temp_buffer = get_sector_buffer();
-    if (temp_buffer == NULL) {
-        print("fs     : ERROR - Cannot allocate sector buffer\n");
-        return -1;
+    // Datos en la entrada: ya están en memoria
+    if (fs_is_inline(file)) {
+        memcpy(buffer, file->data + file_desc->position, size);
+        file_desc->position += size;
+        file_desc->ra_prev_end = file_desc->position;
+        return size;
+    }
+    if (file->flags & FS_FLAG_COMPRESSED) {
+        return fs_zread(file_desc, buffer, size, NULL);
     }
     
-    if (ide_read_sectors(IDE_MASTER, sector, 1, temp_buffer) != 0) {
-        release_sector_buffer(temp_buffer);
-        return -1;
+    // Las lecturas grandes van directas: anticipar solo las pequeñas
+    if (size < FS_DIRECT_MIN * SECTOR_SIZE) {
+        fs_readahead(file_desc, size);
     }
     
-    memcpy(buffer, temp_buffer + offset, size);
-    release_sector_buffer(temp_buffer);
+    // Cabeza y cola parciales desde la caché de bloques; los sectores
+    // enteros del medio, directos al buffer en un comando por tramo
+    u8 *dest = (u8 *)buffer;
+    u32 done = 0;
+    
+    while (done < size) {
+        u32 run = 0;
+        u32 sector = fs_bmap(file, file_desc->position / SECTOR_SIZE, &run);
+        u32 offset = file_desc->position % SECTOR_SIZE;
+        u32 n = SECTOR_SIZE - offset;
+        if (n > size - done) n = size - done;
+        
+        u32 whole = (size - done) / SECTOR_SIZE;
+        if (sector && offset == 0 && whole >= FS_DIRECT_MIN) {
+            if (whole > run) whole = run;
+            if (bcache_read_direct(fs_dev, sector, whole, dest + done) != 0) {
+                return done ? (int)done : -1;
+            }
+            file_desc->position += whole * SECTOR_SIZE;
+            done += whole * SECTOR_SIZE;
+            continue;
+        }
+        
+        struct bcache_buf *b = sector ? bcache_read(fs_dev, sector) : NULL;
+        if (b == NULL) {
+            return done ? (int)done : -1;
+        }
+        memcpy(dest + done, b->data + offset, n);
+        bcache_release(b);
+        
+        file_desc->position += n;
+        done += n;
+    }
     
-    file_desc->position += size;
-    return size;
+    file_desc->ra_prev_end = file_desc->position;
+    return done;
 }
 
-/* Optimized streaming read function for large files */
-int fs_stream_read(int fd, void (*output_func)(char), u32 chunk_size) {
+/*
+ * Lectura en flujo: hasta chunk_size bytes, entregados a 'output_func'
+ * en tramos (buffer, longitud) sacados directamente de los bloques de la
+ * caché, una llamada por sector.
+ */
+int fs_stream_read(int fd, void (*output_func)(const char *buf, u32 len), u32 chunk_size) {
     if (fd < 0 || fd >= MAX_FILES || !open_files[fd].used) {
         return -1;
     }
@@ -207,40 +1895,100 @@ int fs_stream_read(int fd, void (*output_func)(char), u32 chunk_size) {
         return 0; // EOF
     }
     
-    char *temp_buffer = get_sector_buffer();
-    if (temp_buffer == NULL) {
-        print("fs     : ERROR - Cannot allocate sector buffer\n");
-        return -1;
-    }
-    
     u32 total_read = 0;
     u32 remaining = file->size - file_desc->position;
     
+    if (fs_is_inline(file)) {
+        total_read = (remaining < chunk_size) ? remaining : chunk_size;
+        output_func((const char *)file->data + file_desc->position, total_read);
+        file_desc->position += total_read;
+        file_desc->ra_prev_end = file_desc->position;
+        return total_read;
+    }
+    if (file->flags & FS_FLAG_COMPRESSED) {
+        return fs_zread(file_desc, NULL, (remaining < chunk_size) ? remaining : chunk_size, output_func);
+    }
+    
+    fs_readahead(file_desc, (remaining < chunk_size) ? remaining : chunk_size);
+    
     while (remaining > 0 && total_read < chunk_size) {
-        u32 sector = file->start_sector + (file_desc->position / SECTOR_SIZE);
+        u32 sector = fs_bmap(file, file_desc->position / SECTOR_SIZE, NULL);
         u32 offset = file_desc->position % SECTOR_SIZE;
         
-        if (ide_read_sectors(IDE_MASTER, sector, 1, temp_buffer) != 0) {
-            release_sector_buffer(temp_buffer);
+        struct bcache_buf *b = sector ? bcache_read(fs_dev, sector) : NULL;
+        if (b == NULL) {
             return -1;
         }
         
         u32 bytes_in_sector = SECTOR_SIZE - offset;
         u32 bytes_to_read = (remaining < bytes_in_sector) ? remaining : bytes_in_sector;
-        
-        for (u32 i = 0; i < bytes_to_read; i++) {
-            output_func(temp_buffer[offset + i]);
+        if (bytes_to_read > chunk_size - total_read) {
+            bytes_to_read = chunk_size - total_read;
         }
         
+        output_func((const char *)b->data + offset, bytes_to_read);
+        bcache_release(b);
+        
         file_desc->position += bytes_to_read;
         total_read += bytes_to_read;
         remaining -= bytes_to_read;
     }
     
-    release_sector_buffer(temp_buffer);
+    file_desc->ra_prev_end = file_desc->position;
     return total_read;
 }
 
+/*
+ * Bloque de caché del sector 'sector' para escribir n bytes en la
+ * posición 'pos' del archivo. Solo se lee del disco si el sector guarda
+ * datos del archivo fuera de lo que se escribe; si no (sector entero o
+ * más allá del final) se reutiliza sin leer y el resto se pone a cero.
+ */
+static struct bcache_buf *fs_write_block(struct file_entry *file, u32 sector, u32 pos, u32 n) {
+    u32 offset = pos % SECTOR_SIZE;
+    u32 base = pos - offset;
+    
+    if ((offset > 0 && file->size > base) ||
+        (offset + n < SECTOR_SIZE && pos + n < file->size)) {
+        return bcache_read(fs_dev, sector);
+    }
+    
+    struct bcache_buf *b = bcache_get(fs_dev, sector);
+    if (b == NULL) {
+        return NULL;
+    }
+    memset(b->data, 0, offset);
+    memset(b->data + offset + n, 0, SECTOR_SIZE - offset - n);
+    return b;
+}
+
+/*
+ * Sacar de la entrada los datos de un archivo que va a pasar de
+ * FS_INLINE_MAX bytes: se reserva solo su primer sector (el resto lo
+ * reserva el llamador por tramos) y los datos pasan a él. El sector se
+ * escribe en el disco antes de journalizar la entrada que apunta a él:
+ * tras un replay nunca apunta a basura.
+ */
+static int fs_inline_promote(struct fs_inode *ino) {
+    struct file_entry *file = &ino->entry;
+    u8 data[FS_INLINE_MAX];
+    u8 sector[SECTOR_SIZE];
+    
+    memcpy(data, file->data, FS_INLINE_MAX);
+    memset(sector, 0, SECTOR_SIZE);
+    memcpy(sector, data, file->size);
+    memset(file->data, 0, FS_INLINE_MAX);
+    if (fs_grow(file, SECTOR_SIZE) != 0 ||
+        bcache_write_direct(fs_dev, file->extents[0].start, 1, sector) != 0) {
+        fs_free_file(file);
+        memcpy(file->data, data, FS_INLINE_MAX);
+        return -1;
+    }
+    
+    fs_inode_write(ino);
+    return 0;
+}
+
 /* Escribir a un archivo */
 int fs_write_file(int fd, const void *buffer, u32 size) {
     if (fd < 0 || fd >= MAX_FILES || !open_files[fd].used) {
@@ -250,73 +1998,227 @@ int fs_write_file(int fd, const void *buffer, u32 size) {
     struct file_descriptor *file_desc = &open_files[fd];
     struct file_entry *file = file_desc->entry;
     
-    // Verificar límites
-    if (file_desc->position + size > file->size) {
-        return -1; // Archivo demasiado pequeño
+    // Crecer si la escritura pasa del final
+    if (file_desc->position + size < file_desc->position) {
+        return -1;
     }
     
-    // Escribir al disco usando shared buffer
-    u32 sector = file->start_sector + (file_desc->position / SECTOR_SIZE);
-    u32 offset = file_desc->position % SECTOR_SIZE;
+    if (file->flags & FS_FLAG_COMPRESSED) {
+        return fs_zwrite(file_desc, buffer, size);
+    }
     
-    char *temp_buffer = get_sector_buffer();
-    if (temp_buffer == NULL) {
-        print("fs     : ERROR - Cannot allocate sector buffer\n");
-        return -1;
+    // Mientras quepa, el archivo sigue en su entrada
+    if (fs_is_inline(file) && file_desc->position + size <= FS_INLINE_MAX) {
+        journal_begin();
+        memcpy(file->data + file_desc->position, buffer, size);
+        file_desc->position += size;
+        if (file_desc->position > file->size) {
+            file->size = file_desc->position;
+        }
+        fs_inode_write(file_desc->inode);
+        return size;
+    }
+    if (fs_is_inline(file)) {
+        journal_begin();
+        if (fs_inline_promote(file_desc->inode) != 0) {
+            return -1;      // Sin espacio
+        }
+    }
+    if (file_desc->position + size > file->size &&
+        fs_grow_steps(file_desc->inode, file_desc->position + size) != 0) {
+        return -1;          // Sin espacio o demasiado fragmentado
+    }
+    
+    // Cabeza y cola parciales en la caché, escritas en diferido; los
+    // sectores enteros del medio, directos en un comando por tramo
+    const u8 *src = (const u8 *)buffer;
+    u32 done = 0;
+    
+    while (done < size) {
+        u32 run = 0;
+        u32 sector = fs_bmap(file, file_desc->position / SECTOR_SIZE, &run);
+        u32 offset = file_desc->position % SECTOR_SIZE;
+        u32 n = SECTOR_SIZE - offset;
+        if (n > size - done) n = size - done;
+        
+        // Fuera de las extensiones: no escribir nunca en el sector 0
+        if (sector == 0) {
+            break;
+        }
+        
+        u32 whole = (size - done) / SECTOR_SIZE;
+        if (offset == 0 && whole >= FS_DIRECT_MIN) {
+            if (whole > run) whole = run;
+            if (bcache_write_direct(fs_dev, sector, whole, src + done) != 0) {
+                break;
+            }
+            file_desc->position += whole * SECTOR_SIZE;
+            done += whole * SECTOR_SIZE;
+            continue;
+        }
+        
+        struct bcache_buf *b = fs_write_block(file, sector, file_desc->position, n);
+        if (b == NULL) {
+            break;
+        }
+        memcpy(b->data + offset, src + done, n);
+        bcache_mark_dirty(b);
+        bcache_release(b);
+        
+        file_desc->position += n;
+        done += n;
     }
     
-    // Leer el sector actual
-    if (ide_read_sectors(IDE_MASTER, sector, 1, temp_buffer) != 0) {
-        release_sector_buffer(temp_buffer);
+    // Nuevo tamaño al directorio (las extensiones ya están)
+    if (file_desc->position > file->size) {
+        journal_begin();
+        file->size = file_desc->position;
+        fs_inode_write(file_desc->inode);
+    }
+    
+    return (done || size == 0) ? (int)done : -1;
+}
+
+/*
+ * Pasar un archivo cerrado al modo comprimido. La copia comprimida se
+ * escribe entera en sectores nuevos mientras la entrada sigue apuntando
+ * a los originales; solo entonces se cambia la entrada y se liberan, en
+ * la misma operación. Si algo falla el archivo queda como estaba.
+ */
+int fs_compress_file(const char *path) {
+    int fd = fs_open_file(path);
+    struct file_descriptor *file_desc;
+    struct file_entry *file;
+    struct file_entry old, z;
+    u16 index[FS_ZCHUNKS_MAX];
+    u8 *data;
+    u32 size, idx;
+    
+    if (fd < 0) {
+        return -1;
+    }
+    file_desc = &open_files[fd];
+    file = file_desc->entry;
+    size = file->size;
+    if ((file->flags & FS_FLAG_COMPRESSED) || file_desc->inode->refs > 1 ||
+        size > FS_ZCHUNKS_MAX * FS_ZCHUNK) {
+        fs_close_file(fd);
         return -1;
     }
     
-    // Modificar el buffer
-    memcpy(temp_buffer + offset, buffer, size);
+    data = (u8 *)kmalloc(size ? size : 1);
+    if (data == NULL || fs_read_file(fd, data, size) != (int)size || fs_zflush() != 0) {
+        if (data) {
+            kfree(data);
+        }
+        fs_close_file(fd);
+        return -1;
+    }
+    fs_zino = NULL;     // fs_zdata pasa a ser el buffer de trabajo
     
-    // Escribir de vuelta
-    if (ide_write_sectors(IDE_MASTER, sector, 1, temp_buffer) != 0) {
-        release_sector_buffer(temp_buffer);
+    // Índice y trozos, directos al disco, en sectores que nadie ve aún
+    journal_begin();
+    memset(&z, 0, sizeof(struct file_entry));
+    memset(index, 0, sizeof(index));
+    if (fs_grow(&z, fs_zsectors(size) * SECTOR_SIZE) != 0) {
+        fs_free_file(&z);
+        kfree(data);
+        fs_close_file(fd);
+        return -1;      // Sin espacio para la copia
+    }
+    for (idx = 0; idx * FS_ZCHUNK < size; idx++) {
+        u32 n = size - idx * FS_ZCHUNK;
+        
+        if (n > FS_ZCHUNK) n = FS_ZCHUNK;
+        memcpy(fs_zdata, data + idx * FS_ZCHUNK, n);
+        memset(fs_zdata + n, 0, FS_ZCHUNK - n);
+        index[idx] = fs_zput(&z, idx, 0);
+        if (index[idx] == 0) {
+            break;
+        }
+    }
+    kfree(data);
+    if (idx * FS_ZCHUNK < size ||
+        bcache_write_direct(fs_dev, z.extents[0].start, 1, index) != 0) {
+        fs_free_file(&z);
+        fs_close_file(fd);
         return -1;
     }
     
-    release_sector_buffer(temp_buffer);
-    file_desc->position += size;
-    return size;
+    // Ya está en el disco: cambiar la entrada y soltar lo viejo
+    old = *file;
+    memset(file->data, 0, FS_INLINE_MAX);
+    memcpy(file->extents, z.extents, sizeof(file->extents));
+    file->nextents = z.nextents;
+    file->flags |= FS_FLAG_COMPRESSED;
+    fs_inode_write(file_desc->inode);
+    fs_free_file(&old);
+    
+    fs_close_file(fd);
+    return 0;
 }
 
-/* Listar archivos */
-int fs_list_files(void) {
-    int i;
+/* Listar un directorio */
+int fs_list_files(const char *path) {
+    struct fs_inode *dir = fs_namei(path, NULL);
+    u32 blk, i;
     int count = 0;
     
-    print("Files in root directory:\n");
+    if (dir == NULL || dir->entry.type != FILE_TYPE_DIRECTORY) {
+        if (dir) {
+            fs_iput(dir);
+        }
+        print("Directory not found: ");
+        print((char *)path);
+        print("\n");
+        return -1;
+    }
+    
+    print("Files in ");
+    print((char *)path);
+    print(":\n");
     print("Name                Size     Type\n");
     print("----                ----     ----\n");
     
-    for (i = 0; i < MAX_FILES; i++) {
-        if (root_dir.files[i].used) {
-            print(root_dir.files[i].name);
-            
-            // Pad with spaces
-            u32 name_len = strlen(root_dir.files[i].name);
-            for (u32 j = name_len; j < 20; j++) {
-                print(" ");
-            }
-            
-            print_dec(root_dir.files[i].size);
-            print("     ");
-            
-            if (root_dir.files[i].type == FILE_TYPE_REGULAR) {
-                print("FILE");
-            } else if (root_dir.files[i].type == FILE_TYPE_DIRECTORY) {
-                print("DIR");
+    // Las entradas están en los bloques marcados como tales, en su sitio
+    for (blk = 1; blk < dir->entry.size / SECTOR_SIZE; blk++) {
+        struct bcache_buf *b = fs_dir_bread(dir, blk);
+        struct fs_dir_block *db;
+    
+        if (b == NULL) {
+            break;
+        }
+        db = (struct fs_dir_block *)b->data;
+        for (i = 0; db->magic == FS_DIR_BLOCK_MAGIC && i < FS_DIR_PER_BLOCK; i++) {
+            struct file_entry *file = &db->entries[i];
+    
+            if (file->used) {
+                print(file->name);
+    
+                // Pad with spaces
+                u32 name_len = strlen(file->name);
+                for (u32 j = name_len; j < 20; j++) {
+                    print(" ");
+                }
+    
+                print_dec(file->size);
+                print("     ");
+    
+                if (file->flags & FS_FLAG_COMPRESSED) {
+                    print("FILE LZ");
+                } else if (file->type == FILE_TYPE_REGULAR) {
+                    print("FILE");
+                } else if (file->type == FILE_TYPE_DIRECTORY) {
+                    print("DIR");
+                }
+    
+                print("\n");
+                count++;
             }
-            
-            print("\n");
-            count++;
         }
+        bcache_release(b);
     }
+    fs_iput(dir);
     
     print("Total files: ");
     print_dec(count);
@@ -325,49 +2227,72 @@ int fs_list_files(void) {
     return count;
 }
 
-/* Buscar un archivo */
-struct file_entry *fs_find_file(const char *name) {
-    int i;
+/*
+ * Buscar un archivo por su ruta. La entrada sigue en memoria mientras el
+ * archivo esté abierto; si no, solo hasta la siguiente llamada al fs.
+ */
+struct file_entry *fs_find_file(const char *path) {
+    struct fs_inode *ino = fs_namei(path, NULL);
     
-    for (i = 0; i < MAX_FILES; i++) {
-        if (root_dir.files[i].used) {
-            // Comparar nombres
-            char *file_name = root_dir.files[i].name;
-            const char *search_name = name;
-            
-            u8 match = 1;
-            while (*file_name && *search_name) {
-                if (*file_name != *search_name) {
-                    match = 0;
-                    break;
-                }
-                file_name++;
-                search_name++;
+    if (ino == NULL) {
+        return NULL;
+    }
+    fs_iput(ino);
+    return &ino->entry;
+}
+
+/* Sumar a las estadísticas un directorio y lo que cuelga de él */
+static void fs_count_dir(struct fs_inode *dir, struct fs_stats *stats, int depth) {
+    u32 blk, i;
+    
+    for (blk = 1; blk < dir->entry.size / SECTOR_SIZE; blk++) {
+        struct bcache_buf *b = fs_dir_bread(dir, blk);
+        struct fs_dir_block *db;
+    
+        if (b == NULL) {
+            break;
+        }
+        db = (struct fs_dir_block *)b->data;
+        for (i = 0; db->magic == FS_DIR_BLOCK_MAGIC && i < FS_DIR_PER_BLOCK; i++) {
+            struct file_entry *file = &db->entries[i];
+    
+            if (!file->used) {
+                continue;
             }
-            
-            if (match && *file_name == '\0' && *search_name == '\0') {
-                return &root_dir.files[i];
+            stats->total_files++;
+            if (file->type != FILE_TYPE_DIRECTORY) {
+                stats->total_size += file->size;
+                stats->inline_files += fs_is_inline(file);
+                continue;
+            }
+            stats->total_dirs++;
+            if (depth < FS_DIR_DEPTH) {
+                struct fs_inode sub;
+    
+                // Para leer sus bloques basta con las extensiones
+                sub.entry = *file;
+                fs_count_dir(&sub, stats, depth + 1);
             }
         }
+        bcache_release(b);
     }
-    
-    return NULL;
 }
 
 /* Get file system statistics */
 void fs_get_stats(struct fs_stats *stats) {
     stats->total_files = 0;
+    stats->total_dirs = 0;
+    stats->inline_files = 0;
     stats->total_size = 0;
-    
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (root_dir.files[i].used) {
-            stats->total_files++;
-            stats->total_size += root_dir.files[i].size;
-        }
+    stats->total_sectors = 0;
+    stats->free_sectors = 0;
+    stats->largest_free = 0;
+    if (fs_bitmap) {
+        fs_count_dir(fs_root, stats, 0);
+        stats->total_sectors = fs_sb.total_sectors - fs_sb.data_start;
+        stats->free_sectors = fs_sb.free_sectors;
+        stats->largest_free = fs_scan_free(0);
     }
-    
-    stats->free_files = MAX_FILES - stats->total_files;
-    stats->next_free_sector = next_free_sector;
 }
 
 /* Print file system statistics */
@@ -379,15 +2304,85 @@ void fs_print_stats(void) {
     print("======================\n");
     print("Total files: ");
     print_dec(stats.total_files);
-    print("/");
-    print_dec(MAX_FILES);
-    print("\n");
+    print(" (");
+    print_dec(stats.total_dirs);
+    print(" directories, ");
+    print_dec(stats.inline_files);
+    print(" inline)\n");
     
     print("Total size: ");
     print_dec(stats.total_size);
     print(" bytes\n");
     
-    print("Next free sector: ");
-    print_dec(stats.next_free_sector);
+    print("Free space: ");
+    print_dec(stats.free_sectors / 2);
+    print("/");
+    print_dec(stats.total_sectors / 2);
+    print(" KB (largest free extent ");
+    print_dec(stats.largest_free / 2);
+    print(" KB)\n");
+    
+    u32 lookups = fs_dcache_stats.hits + fs_dcache_stats.negative + fs_dcache_stats.misses;
+    print("Name cache: ");
+    print_dec(FS_DCACHE_SIZE);
+    print(" entries\n  Hits: ");
+    print_dec(fs_dcache_stats.hits);
+    print(" (+");
+    print_dec(fs_dcache_stats.negative);
+    print(" negative)  Misses: ");
+    print_dec(fs_dcache_stats.misses);
+    if (lookups) {
+        print("  Hit rate: ");
+        print_dec((fs_dcache_stats.hits + fs_dcache_stats.negative) * 100 / lookups);
+        print("%");
+    }
+    print("  Evictions: ");
+    print_dec(fs_dcache_stats.evictions);
     print("\n");
+    
+    if (fs_zstats.chunks_written || fs_zstats.chunks_read) {
+        u32 out = fs_zstats.bytes_out ? fs_zstats.bytes_out : 1;
+        u32 rem = fs_zstats.bytes_in % out;
+        u32 frac = (out >= 100) ? rem / (out / 100) : rem * 100 / out;
+        
+        if (frac > 99) frac = 99;
+        print("Compression: ");
+        print_dec(fs_zstats.chunks_written);
+        print(" chunks written (");
+        print_dec(fs_zstats.raw_chunks);
+        print(" raw), ratio ");
+        print_dec(fs_zstats.bytes_in / out);
+        print(frac < 10 ? ".0" : ".");
+        print_dec(frac);
+        print("\n  Read: ");
+        print_dec(fs_zstats.chunks_read);
+        print(" chunks, ");
+        print_dec(fs_zstats.sectors_read);
+        print(" sectors (");
+        print_dec(fs_zstats.sectors_saved);
+        print(" saved)  Time: compress ");
+        print_dec(cpu_cycles_to_us(fs_zstats.compress_cycles));
+        print("us, decompress ");
+        print_dec(cpu_cycles_to_us(fs_zstats.decompress_cycles));
+        print("us\n");
+    }
+    
+    journal_print_stats();
+    bcache_print_stats();
+}
+
+/*
+ * Escribir a disco todo lo pendiente del sistema de archivos: se confirma
+ * la transacción en curso del diario y se hace un checkpoint.
+ */
+int fs_sync(void) {
+    if (fs_dev == NULL) {
+        return -1;
+    }
+    if (fs_zflush() != 0) {
+        print("fs     : ERROR - Cannot write compressed data\n");
+        journal_checkpoint();
+        return -1;
+    }
+    return journal_checkpoint();
 }
\ No newline at end of file
@@ -3,60 +3,256 @@
 
 #include "types.h"
 
-#define MAX_FILES 32
+#define MAX_FILES 32            /* descriptores abiertos a la vez */
 #define MAX_FILENAME 32
 #define SECTOR_SIZE 512
 
+/* Lectura anticipada: ventana en sectores */
+#define FS_RA_MIN 4
+#define FS_RA_MAX 64
+
+/* E/S de al menos estos sectores enteros va directa, sin la caché */
+#define FS_DIRECT_MIN 8
+
+/* Dispositivo del fs; se puede cambiar al compilar: make FS_DEVICE=vda */
+#ifndef FS_DEFAULT_DEVICE
+#define FS_DEFAULT_DEVICE "hda"
+#endif
+
+/*
+ * Formato en disco: sector 0 reservado, superbloque en el 1, después el
+ * bitmap de sectores libres (1 bit por sector, 1 = usado), el diario de
+ * metadatos y la zona de datos. Los directorios son archivos de la zona
+ * de datos; la entrada del raíz la guarda el superbloque.
+ */
+#define FS_MAGIC            0x46504550  /* "PEPF" */
+#define FS_VERSION          7
+#define FS_SUPERBLOCK_SECTOR 1
+#define FS_MAX_SECTORS      (1 << 20)   /* 512MB: bitmap de 128KB en memoria */
+#define FS_BITS_PER_SECTOR  (SECTOR_SIZE * 8)
+#define FS_JOURNAL_SECTORS  256         /* 128KB de diario */
+
+/* Extensiones por archivo y tamaño mínimo de una nueva al crecer */
+#define FS_MAX_EXTENTS      4
+#define FS_EXTENT_MIN       16          /* sectores reservados de una vez */
+
+/*
+ * Una operación del diario reserva o libera como mucho FS_GROW_STEP
+ * sectores (lo demás, en operaciones sucesivas), así que toca como mucho
+ * FS_GROW_BITMAP sectores del bitmap por cada fs_grow(). FS_OP_BLOCKS es
+ * lo más que toca una operación entera: dos crecimientos (directorio y
+ * archivo), superbloque, entradas, cabecera, un nodo y su hermano nuevo
+ * por nivel del árbol más la raíz nueva, y cabecera y hoja de un
+ * directorio recién creado.
+ */
+#define FS_GROW_STEP        (4 * FS_BITS_PER_SECTOR)
+#define FS_GROW_BITMAP      (FS_GROW_STEP / FS_BITS_PER_SECTOR + 2 * (FS_MAX_EXTENTS + 1))
+#define FS_OP_BLOCKS        (2 * FS_GROW_BITMAP + 2 * FS_BT_MAX_DEPTH + 7)
+
+/*
+ * Archivos de hasta FS_INLINE_MAX bytes: los datos van en la propia
+ * entrada, en el sitio de las extensiones (al menos FS_MAX_EXTENTS * 8).
+ * Con 87 caben 4 entradas justas por bloque de directorio.
+ */
+#ifndef FS_INLINE_MAX
+#define FS_INLINE_MAX       87
+#endif
+
+/*
+ * Archivos comprimidos: trozos de FS_ZCHUNK bytes comprimidos cada uno
+ * por separado. El primer sector es el índice (longitud comprimida de
+ * cada trozo, u16) y detrás cada trozo tiene un hueco fijo de
+ * FS_ZCHUNK_SECTORS, del que solo se leen los sectores que ocupa.
+ */
+#define FS_ZCHUNK           4096
+#define FS_ZCHUNK_SECTORS   (FS_ZCHUNK / SECTOR_SIZE)
+#define FS_ZCHUNKS_MAX      (SECTOR_SIZE / 2)   /* 1MB por archivo */
+
+/* Opciones de un archivo (file_entry.flags) */
+#define FS_FLAG_COMPRESSED  0x01
+
+/*
+ * Directorio: bloque 0 de cabecera y, mezclados según se necesitan,
+ * bloques de entradas (FS_DIR_PER_BLOCK por bloque, nunca se mueven) y
+ * nodos de un árbol B+ que indexa las entradas por hash del nombre. Al
+ * quedarse sin sitio el archivo se multiplica por FS_DIR_GROWTH.
+ */
+#define FS_DIR_MAGIC        0x52494450  /* "PDIR" */
+#define FS_DIR_BLOCK_MAGIC  0x544E4550  /* "PENT" */
+#define FS_BT_MAGIC         0x45525442  /* "BTRE" */
+#define FS_DIR_GROWTH       4
+#define FS_DIR_PER_BLOCK    ((SECTOR_SIZE - 4) / sizeof(struct file_entry))
+#define FS_BT_ORDER         62          /* pares por hoja (hijos por nodo interno) */
+#define FS_BT_MAX_DEPTH     4
+#define FS_DIR_RESERVE      (FS_BT_MAX_DEPTH + 2)   /* bloques libres antes de insertar */
+#define FS_NO_SLOT          0xFFFFFFFF
+
+/* Archivos y directorios en memoria a la vez (abiertos o de paso) */
+#define FS_INODES           64
+#define FS_DIR_DEPTH        16          /* niveles que recorre 'fsstat' */
+
+/* Caché de nombres: últimas búsquedas por (directorio, nombre) */
+#define FS_DCACHE_SIZE      128
+#define FS_DCACHE_HASH      64          /* potencia de 2 */
+
 /* Tipos de archivos */
 #define FILE_TYPE_REGULAR   1
 #define FILE_TYPE_DIRECTORY 2
 
+/* Tramo contiguo de sectores de un archivo */
+struct fs_extent {
+    u32 start;
+    u32 count;
+} __attribute__((packed));
+
 /* Estructura de entrada de archivo */
 struct file_entry {
     char name[MAX_FILENAME];
     u32 size;
-    u32 start_sector;
     u8 type;
     u8 used;
+    u8 nextents;            /* 0 en un archivo regular: datos en 'data' */
+    u8 flags;               /* FS_FLAG_* */
+    union {
+        struct fs_extent extents[FS_MAX_EXTENTS];
+        u8 data[FS_INLINE_MAX];
+    };
 } __attribute__((packed));
 
-/* Estructura de directorio */
-struct directory {
-    struct file_entry files[MAX_FILES];
-    u32 count;
+/* Cabecera de un directorio (bloque 0) */
+struct fs_dir_header {
+    u32 magic;
+    u32 root;               /* bloque raíz del árbol B+ */
+    u32 count;              /* entradas en uso */
+    u32 free_slot;          /* primera entrada libre (lista por 'size') */
 } __attribute__((packed));
 
+/* Bloque de entradas: la posición de cada una es fija */
+struct fs_dir_block {
+    struct file_entry entries[FS_DIR_PER_BLOCK];
+    u8 pad[SECTOR_SIZE - 4 - FS_DIR_PER_BLOCK * sizeof(struct file_entry)];
+    u32 magic;              /* FS_DIR_BLOCK_MAGIC */
+} __attribute__((packed));
+
+/*
+ * Nodo del árbol B+: claves = hash del nombre, ordenadas y con repetidos.
+ * En las hojas val[i] es la entrada de key[i] y 'next' enlaza la hoja
+ * siguiente; en los internos val[0..count] son los hijos y key[i] separa
+ * val[i] (<=) de val[i + 1] (>=).
+ */
+struct fs_bt_node {
+    u32 magic;
+    u16 leaf;
+    u16 count;
+    u32 next;
+    u32 key[FS_BT_ORDER];
+    u32 val[FS_BT_ORDER];
+} __attribute__((packed));
+
+/* Superbloque */
+struct fs_superblock {
+    u32 magic;
+    u32 version;
+    u32 total_sectors;      /* sectores gestionados por el fs */
+    u32 bitmap_start;
+    u32 bitmap_sectors;
+    u32 journal_start;
+    u32 journal_sectors;
+    u32 data_start;
+    u32 free_sectors;
+    struct file_entry root;     /* directorio raíz: size = bloques * 512 */
+} __attribute__((packed));
+
+/*
+ * Archivo o directorio en memoria: copia de su entrada y dónde está. Cada
+ * uno retiene a su padre, así que los antepasados de algo en memoria no
+ * se reciclan; los que nadie referencia se reutilizan por antigüedad.
+ */
+struct fs_inode {
+    struct file_entry entry;
+    struct fs_dir_header dir;   /* cabecera, si es un directorio */
+    struct fs_inode *parent;    /* NULL: raíz */
+    u32 slot;                   /* entrada en el directorio padre */
+    u16 refs;                   /* descriptores e hijos en memoria */
+    u8 used;
+    u32 stamp;                  /* último uso */
+};
+
+/*
+ * Resultado de buscar 'name' en 'dir': su entrada o FS_NO_SLOT si no
+ * existe (también se recuerdan los fallos). Las libres tienen dir = NULL.
+ */
+struct fs_dentry {
+    struct fs_inode *dir;
+    char name[MAX_FILENAME];
+    u32 hash;
+    u32 slot;
+    struct fs_dentry *hash_next;
+    struct fs_dentry *lru_prev;     /* lista LRU: cabeza = más reciente */
+    struct fs_dentry *lru_next;
+};
+
+/* Contadores de la caché de nombres */
+struct fs_dcache_stats {
+    u32 hits;
+    u32 negative;           /* aciertos de nombres que no existen */
+    u32 misses;
+    u32 evictions;
+};
+
+/* Contadores de la compresión */
+struct fs_zstats {
+    u32 chunks_written;
+    u32 raw_chunks;         /* no ahorraban un sector: guardados tal cual */
+    u32 bytes_in;           /* sin comprimir */
+    u32 bytes_out;          /* comprimidos */
+    u32 chunks_read;
+    u32 sectors_read;
+    u32 sectors_saved;      /* frente a leer los trozos sin comprimir */
+    u64 compress_cycles;
+    u64 decompress_cycles;
+};
+
 /* Descriptor de archivo */
 struct file_descriptor {
     struct file_entry *entry;
+    struct fs_inode *inode;
     u32 position;
     u8 used;
+    u32 ra_prev_end;    /* posición tras la última lectura */
+    u32 ra_window;      /* ventana actual de lectura anticipada (sectores) */
+    u32 ra_end;         /* sector relativo hasta el que ya se anticipó */
 };
 
 /* File system statistics */
 struct fs_stats {
     u32 total_files;
-    u32 free_files;
+    u32 total_dirs;
+    u32 inline_files;       /* con los datos en su entrada */
     u32 total_size;
-    u32 next_free_sector;
+    u32 total_sectors;
+    u32 free_sectors;
+    u32 largest_free;       /* mayor tramo contiguo libre */
 };
 
 /* Variables globales */
-extern struct directory root_dir;
 extern struct file_descriptor open_files[MAX_FILES];
 
 /* Funciones del sistema de archivos */
 void fs_init(void);
-int fs_create_file(const char *name, u32 size);
-int fs_delete_file(const char *name);
-int fs_open_file(const char *name);
+int fs_create_file(const char *path, u32 size);
+int fs_mkdir(const char *path);
+int fs_delete_file(const char *path);
+int fs_open_file(const char *path);
 void fs_close_file(int fd);
 int fs_read_file(int fd, void *buffer, u32 size);
-int fs_stream_read(int fd, void (*output_func)(char), u32 chunk_size);
+int fs_stream_read(int fd, void (*output_func)(const char *buf, u32 len), u32 chunk_size);
 int fs_write_file(int fd, const void *buffer, u32 size);
-int fs_list_files(void);
-struct file_entry *fs_find_file(const char *name);
+int fs_list_files(const char *path);
+int fs_compress_file(const char *path);
+struct file_entry *fs_find_file(const char *path);
 void fs_get_stats(struct fs_stats *stats);
 void fs_print_stats(void);
+int fs_sync(void);
 
 #endif
\ No newline at end of file
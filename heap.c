@@ -228,6 +228,17 @@ void *kmalloc(u32 size) {
     return kmalloc_debug(size, "unknown", 0);
 }
 
+/*
+ * Reserva memoria alineada para estructuras de DMA (tablas PRD, colas).
+ * Son reservas permanentes de los drivers: no se liberan con kfree.
+ */
+void *kmalloc_aligned(u32 size, u32 align) {
+    u32 raw = (u32)kmalloc(size + align);
+    
+    if (!raw) return 0;
+    return (void *)((raw + align - 1) & ~(align - 1));
+}
+
 void kfree(void *ptr) {
     if (!ptr) return;
     
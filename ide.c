@@ -3,13 +3,49 @@
 #include "screen.h"
 #include "lib.h"
 #include "mm.h"
+#include "pci.h"
+#include "idt.h"
+#include "blockdev.h"
+
+// Canales primario y secundario
+static struct ide_channel ide_channels[IDE_CHANNELS] = {
+    { IDE_PRIMARY_BASE, IDE_PRIMARY_CTRL, IDE_PRIMARY_IRQ },
+    { IDE_SECONDARY_BASE, IDE_SECONDARY_CTRL, IDE_SECONDARY_IRQ }
+};
+
+// Capacidades de las cuatro posiciones (master y slave de cada canal)
+static struct ide_drive ide_drives[IDE_MAX_DRIVES];
+
+// Dispositivos de bloques expuestos al sistema de archivos
+static struct blockdev ide_blockdevs[IDE_MAX_DRIVES];
+static int ide_blk_submit(struct blockdev *dev, struct blk_request *rq);
+static void ide_blk_poll(struct blockdev *dev);
+
+// Unidad del comando DMA asíncrono de cada canal
+static int ide_active_drive[IDE_CHANNELS];
+
+// Bottom half que completa los DMA recogidos por la IRQ
+static int ide_bh = -1;
+static void ide_dma_bh(void);
+
+// Secciones críticas frente a la IRQ del canal
+static u32 ide_irq_save(void) {
+    u32 flags;
+    
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags) :: "memory");
+    return flags;
+}
+
+static void ide_irq_restore(u32 flags) {
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+}
 
 // Función para esperar a que el disco esté listo
-static int ide_wait(int check_error) {
+static int ide_wait(struct ide_channel *ch, int check_error) {
     u8 status;
     
     do {
-        status = inb(IDE_STATUS);
+        status = inb(ch->base + IDE_STATUS);
     } while (status & IDE_STATUS_BSY);
     
     if (check_error && (status & IDE_STATUS_ERR)) {
@@ -20,103 +56,741 @@ static int ide_wait(int check_error) {
     return 0;
 }
 
-// Inicialización del controlador IDE
-void ide_init(void) {
-    outb(IDE_DRIVE_HEAD, 0xE0 | (IDE_MASTER << 4)); // Seleccionar master
-    outb(IDE_SECT_COUNT, 0);
-    outb(IDE_SECT_NUM, 0);
+// Pausa de 400ns tras seleccionar unidad: cuatro lecturas del estado alternativo
+static void ide_delay(struct ide_channel *ch) {
+    int i;
     
-    // Esperar a que el disco esté listo
-    ide_wait(0);
+    for (i = 0; i < 4; i++) {
+        inb(ch->ctrl + IDE_ALT_STATUS);
+    }
+}
+
+// Indica si las interrupciones están habilitadas (EFLAGS.IF)
+static int ide_irqs_enabled(void) {
+    u32 flags;
+    
+    asm volatile("pushfl; popl %0" : "=r" (flags));
+    return (flags & 0x200) != 0;
+}
+
+// El DMA de un comando asíncrono ha terminado (bus master parado o IRQ)
+static int ide_dma_done(struct ide_channel *ch) {
+    u8 bm_status = inb(ch->bmide + IDE_BM_STATUS);
+    
+    if ((bm_status & IDE_BM_STATUS_ACTIVE) && !(bm_status & IDE_BM_STATUS_IRQ)) {
+        return 0;
+    }
+    return !(inb(ch->ctrl + IDE_ALT_STATUS) & IDE_STATUS_BSY);
+}
+
+static void ide_dma_finish(struct ide_channel *ch);
+
+// Manejador de IRQ de un canal: leer IDE_STATUS también confirma la
+// interrupción. Una IRQ atrasada que llega con el disco ocupado se ignora.
+static void ide_channel_int(struct ide_channel *ch) {
+    u8 status;
+    
+    if (ch->active) {
+        if (ide_dma_done(ch)) {
+            ide_dma_finish(ch);
+            bh_raise(ide_bh);
+        }
+        return;
+    }
     
-    print("IDE    : Controller initialized\n");
+    status = inb(ch->base + IDE_STATUS);
+    if (!(status & IDE_STATUS_BSY)) {
+        ch->irq_status = status;
+        ch->irq_pending = 1;
+    }
+}
+
+// IRQ14: canal primario (entrada propia en interrupt.asm)
+void isr_ide_int(void) {
+    ide_channel_int(&ide_channels[0]);
+}
+
+// IRQ15: canal secundario (registrada con irq_install_handler)
+void isr_ide_secondary_int(void) {
+    ide_channel_int(&ide_channels[1]);
+}
+
+// Preparar la espera de la siguiente IRQ antes de enviar un comando
+static void ide_irq_arm(struct ide_channel *ch) {
+    ch->irq_pending = 0;
 }
 
-// Leer sectores del disco
-int ide_read_sectors(int drive, u32 lba, u8 num_sectors, void *buffer) {
-    u16 *buf = (u16 *)buffer;
+/*
+ * Esperar a que el disco termine la fase actual. La tarea que hizo la
+ * petición duerme con hlt hasta la IRQ del canal, así el reloj, el
+ * teclado y el scheduler siguen corriendo durante la transferencia.
+ * Durante el arranque (interrupciones deshabilitadas) se hace polling.
+ */
+static int ide_wait_irq(struct ide_channel *ch) {
+    u8 status;
+    int wakeups = 0;
+    
+    if (!ide_irqs_enabled()) {
+        return ide_wait(ch, 1);
+    }
+    
+    cli;
+    while (!ch->irq_pending) {
+        // Si la IRQ se perdió, no quedarse dormido para siempre
+        if (++wakeups > IDE_IRQ_TIMEOUT &&
+            !(inb(ch->ctrl + IDE_ALT_STATUS) & IDE_STATUS_BSY)) {
+            break;
+        }
+        asm volatile("sti; hlt; cli");
+    }
+    
+    if (ch->irq_pending) {
+        status = ch->irq_status;
+        ch->irq_pending = 0;
+    } else {
+        status = inb(ch->base + IDE_STATUS);
+    }
+    sti;
+    
+    if (status & IDE_STATUS_ERR) {
+        print("IDE    : Error during operation\n");
+        return -1;
+    }
+    
+    return 0;
+}
+
+// Probe del controlador PIIX: BAR4 es la base de los registros bus master
+// de los dos canales (el secundario 8 puertos más arriba)
+static int ide_pci_probe(struct pci_device *dev) {
     int i;
     
-    // Esperar a que el disco esté listo
-    if (ide_wait(1)) return -1;
-    
-    // Configurar parámetros de lectura
-    outb(IDE_DRIVE_HEAD, 0xE0 | (drive << 4) | ((lba >> 24) & 0x0F));
-    outb(IDE_SECT_COUNT, num_sectors);
-    outb(IDE_SECT_NUM, lba & 0xFF);
-    outb(IDE_CYL_LOW, (lba >> 8) & 0xFF);
-    outb(IDE_CYL_HIGH, (lba >> 16) & 0xFF);
-    
-    // Enviar comando de lectura
-    outb(IDE_CMD, IDE_CMD_READ);
-    
-    // Leer datos sector por sector
-    for (i = 0; i < num_sectors; i++) {
-        // Esperar hasta que los datos estén listos
-        if (ide_wait(1)) return -1;
+    if (!(dev->prog_if & 0x80) || !dev->bar_is_io[4] || dev->bar[4] == 0) {
+        return -1; // Sin bus master: los canales siguen en PIO
+    }
+    
+    for (i = 0; i < IDE_CHANNELS; i++) {
+        struct ide_channel *ch = &ide_channels[i];
         
-        // Leer 256 palabras (512 bytes)
-        insl(IDE_DATA, buf, 128);
-        buf += 256;
+        ch->prdt = (struct ide_prd *)kmalloc_aligned(IDE_PRD_ENTRIES * sizeof(struct ide_prd),
+                                                     IDE_PRDT_ALIGN);
+        if (ch->prdt == NULL) {
+            return -1;
+        }
+        ch->bmide = dev->bar[4] + i * IDE_BM_SECONDARY;
+    }
+    
+    pci_enable_device(dev);
+    pci_enable_bus_master(dev);
+    return 0;
+}
+
+static struct pci_driver ide_pci_driver = {
+    "piix-ide", PCI_ANY_ID, PCI_ANY_ID, 0x01, 0x01, ide_pci_probe
+};
+
+// Extraer la capacidad y los modos soportados de los datos de IDENTIFY
+static void ide_parse_identify(struct ide_drive *d, const u16 *ident) {
+    d->present = 1;
+    d->dma = (ident[49] & 0x0100) != 0;
+    d->lba48 = (ident[83] & 0x0400) != 0;
+    
+    if (d->lba48 && (ident[102] == 0 && ident[103] == 0)) {
+        d->sectors = ident[100] | ((u32)ident[101] << 16);
+    } else if (d->lba48) {
+        d->sectors = 0xFFFFFFFF;    // más de 2TB: limitado por el API de 32 bits
+    } else {
+        d->sectors = ident[60] | ((u32)ident[61] << 16);
+    }
+    
+    // Palabra 47: máximo de sectores por bloque en READ/WRITE MULTIPLE
+    d->multiple = ident[47] & 0xFF;
+}
+
+// SET MULTIPLE MODE: una interrupción por bloque en lugar de por sector
+static void ide_set_multiple(int drive) {
+    struct ide_drive *d = &ide_drives[drive];
+    struct ide_channel *ch = &ide_channels[IDE_CHANNEL(drive)];
+    
+    if (d->multiple <= 1) {
+        d->multiple = 0;
+        return;
+    }
+    
+    if (ide_wait(ch, 1)) {
+        d->multiple = 0;
+        return;
+    }
+    
+    outb(ch->base + IDE_DRIVE_HEAD, 0xE0 | (IDE_UNIT(drive) << 4));
+    outb(ch->base + IDE_SECT_COUNT, d->multiple);
+    ide_irq_arm(ch);
+    outb(ch->base + IDE_CMD, IDE_CMD_SET_MULTIPLE);
+    
+    if (ide_wait_irq(ch)) {
+        d->multiple = 0;
+    }
+}
+
+// Exponer una unidad como hda..hdd
+static void ide_register_drive(int drive) {
+    struct ide_drive *d = &ide_drives[drive];
+    struct blockdev *dev = &ide_blockdevs[drive];
+    
+    print("IDE    : hd");
+    putcar('a' + drive);
+    print(IDE_UNIT(drive) == IDE_MASTER ? " (master) " : " (slave) ");
+    print_dec(d->sectors / 2048);
+    print("MB, ");
+    print(d->lba48 ? "LBA48" : "LBA28");
+    if (d->multiple) {
+        print(", multiple ");
+        print_dec(d->multiple);
+    }
+    print("\n");
+    
+    memcpy(dev->name, "hda", 4);
+    dev->name[2] = 'a' + drive;
+    dev->sectors = d->sectors;
+    dev->submit = ide_blk_submit;
+    dev->poll = ide_blk_poll;
+    dev->max_sectors = d->lba48 ?
+        (IDE_PRD_ENTRIES - BLK_MAX_SEGS) * 128 : IDE_LBA28_MAX_COUNT;
+    dev->max_segs = BLK_MAX_SEGS;
+    dev->max_inflight = 1;
+    dev->priv = (void *)drive;
+    blockdev_register(dev);
+}
+
+// Inicialización del controlador IDE: los dos canales y sus cuatro posiciones
+void ide_init(void) {
+    u16 ident[256];
+    int found = 0;
+    int i, drive;
+    
+    memset(ide_drives, 0, sizeof(ide_drives));
+    
+    for (i = 0; i < IDE_CHANNELS; i++) {
+        struct ide_channel *ch = &ide_channels[i];
+        
+        // Bus flotante (p.ej. máquina q35 sin IDE legacy): no hay canal
+        ch->present = inb(ch->base + IDE_STATUS) != 0xFF;
+        if (!ch->present) {
+            continue;
+        }
+        found++;
+        
+        outb(ch->base + IDE_DRIVE_HEAD, 0xE0 | (IDE_MASTER << 4)); // Seleccionar master
+        outb(ch->base + IDE_SECT_COUNT, 0);
+        outb(ch->base + IDE_SECT_NUM, 0);
+        
+        // Habilitar la IRQ del canal (nIEN = 0)
+        outb(ch->ctrl + IDE_CONTROL, 0);
+    }
+    
+    if (!found) {
+        print("IDE    : No controller on legacy channels\n");
+        return;
+    }
+    
+    // Buscar el bus master del controlador en PCI
+    pci_register_driver(&ide_pci_driver);
+    ide_bh = bh_install(ide_dma_bh);
+    
+    if (ide_channels[1].present &&
+        irq_install_handler(IDE_SECONDARY_IRQ, isr_ide_secondary_int) != 0) {
+        print("IDE    : WARNING - cannot install IRQ 15 handler\n");
+    }
+    
+    print("IDE    : Controller initialized (IRQ ");
+    print_dec(IDE_PRIMARY_IRQ);
+    print("/");
+    print_dec(IDE_SECONDARY_IRQ);
+    if (ide_channels[0].bmide) {
+        print(", bus master DMA at ");
+        print_hex(ide_channels[0].bmide);
+    } else {
+        print(", PIO only");
+    }
+    print(")\n");
+    
+    for (drive = 0; drive < IDE_MAX_DRIVES; drive++) {
+        if (!ide_channels[IDE_CHANNEL(drive)].present) {
+            continue;
+        }
+        if (ide_identify(drive, ident) == 0) {
+            ide_parse_identify(&ide_drives[drive], ident);
+            ide_set_multiple(drive);
+            ide_register_drive(drive);
+        }
+    }
+}
+
+// Capacidad de una unidad en sectores (0 si no está presente)
+u32 ide_get_sectors(int drive) {
+    if (drive < 0 || drive >= IDE_MAX_DRIVES || !ide_drives[drive].present) {
+        return 0;
+    }
+    return ide_drives[drive].sectors;
+}
+
+/*
+ * Cargar LBA y número de sectores en los registros de tarea. Con LBA48
+ * cada registro es un FIFO de dos bytes: primero el byte alto.
+ */
+static void ide_setup_lba(int drive, u32 lba, u32 num_sectors, int lba48) {
+    u16 base = ide_channels[IDE_CHANNEL(drive)].base;
+    int unit = IDE_UNIT(drive);
+    
+    if (lba48) {
+        outb(base + IDE_DRIVE_HEAD, 0x40 | (unit << 4));
+        outb(base + IDE_SECT_COUNT, (num_sectors >> 8) & 0xFF);
+        outb(base + IDE_SECT_NUM, (lba >> 24) & 0xFF);
+        outb(base + IDE_CYL_LOW, 0);                    // LBA 32..39
+        outb(base + IDE_CYL_HIGH, 0);                   // LBA 40..47
+        outb(base + IDE_SECT_COUNT, num_sectors & 0xFF);
+        outb(base + IDE_SECT_NUM, lba & 0xFF);
+        outb(base + IDE_CYL_LOW, (lba >> 8) & 0xFF);
+        outb(base + IDE_CYL_HIGH, (lba >> 16) & 0xFF);
+    } else {
+        outb(base + IDE_DRIVE_HEAD, 0xE0 | (unit << 4) | ((lba >> 24) & 0x0F));
+        outb(base + IDE_SECT_COUNT, num_sectors & 0xFF); // 0 significa 256
+        outb(base + IDE_SECT_NUM, lba & 0xFF);
+        outb(base + IDE_CYL_LOW, (lba >> 8) & 0xFF);
+        outb(base + IDE_CYL_HIGH, (lba >> 16) & 0xFF);
+    }
+}
+
+// LBA48 solo cuando hace falta: más de 256 sectores o más allá de 128GB
+static int ide_needs_lba48(u32 lba, u32 num_sectors) {
+    return num_sectors > IDE_LBA28_MAX_COUNT || lba + num_sectors > IDE_LBA28_LIMIT;
+}
+
+// Detener el motor DMA y limpiar IRQ/error (se borran escribiendo 1)
+static u8 ide_dma_stop(struct ide_channel *ch) {
+    u8 bm_status = inb(ch->bmide + IDE_BM_STATUS);
+    
+    outb(ch->bmide + IDE_BM_CMD, 0);
+    outb(ch->bmide + IDE_BM_STATUS, bm_status | IDE_BM_STATUS_IRQ | IDE_BM_STATUS_ERR);
+    return bm_status;
+}
+
+/*
+ * Espera el fin de una transferencia DMA. Con interrupciones se duerme
+ * hasta la IRQ del canal; durante el arranque se consulta el bus master.
+ */
+static int ide_dma_wait(struct ide_channel *ch) {
+    u8 bm_status;
+    
+    if (ide_irqs_enabled()) {
+        if (ide_wait_irq(ch)) return -1;
+    } else {
+        do {
+            bm_status = inb(ch->bmide + IDE_BM_STATUS);
+        } while ((bm_status & IDE_BM_STATUS_ACTIVE) && !(bm_status & IDE_BM_STATUS_IRQ));
+        if (ide_wait(ch, 1)) return -1;
+    }
+    
+    if (ide_dma_stop(ch) & IDE_BM_STATUS_ERR) {
+        print("IDE    : DMA transfer error\n");
+        return -1;
     }
     
     return 0;
 }
 
-// Escribir sectores en el disco
-int ide_write_sectors(int drive, u32 lba, u8 num_sectors, void *buffer) {
-    u16 *buf = (u16 *)buffer;
+/*
+ * Construye la tabla PRD a partir de una lista de segmentos. Ninguna
+ * entrada puede cruzar un límite de 64KB. Devuelve -1 si no cabe.
+ */
+static int ide_build_prdt(struct ide_channel *ch, struct blk_seg *sg, int nsg) {
+    struct ide_prd *prdt = ch->prdt;
+    int n = 0;
     int i;
     
+    for (i = 0; i < nsg; i++) {
+        u32 addr = (u32)sg[i].buf;
+        u32 left = sg[i].count * 512;
+        
+        while (left > 0) {
+            u32 chunk = 0x10000 - (addr & 0xFFFF);
+            if (chunk > left) chunk = left;
+            
+            if (n >= IDE_PRD_ENTRIES) return -1;
+            
+            prdt[n].addr = addr;
+            prdt[n].bytes = chunk & 0xFFFF;  // 0 significa 64KB
+            prdt[n].flags = 0;
+            
+            addr += chunk;
+            left -= chunk;
+            n++;
+        }
+    }
+    
+    if (n == 0) return -1;
+    prdt[n - 1].flags = IDE_PRD_EOT;
+    return 0;
+}
+
+/*
+ * Arranca una transferencia por bus master DMA. Los segmentos se
+ * describen con entradas PRD (scatter/gather) y el fin se notifica con
+ * la IRQ del canal.
+ */
+static int ide_dma_start(int drive, u32 lba, u32 num_sectors,
+                         struct blk_seg *sg, int nsg, int write) {
+    struct ide_channel *ch = &ide_channels[IDE_CHANNEL(drive)];
+    int lba48 = ide_needs_lba48(lba, num_sectors);
+    u8 cmd;
+    
+    if (ide_build_prdt(ch, sg, nsg)) return -1;
+    
+    // Esperar a que el disco esté listo
+    if (ide_wait(ch, 1)) return -1;
+    
+    // Programar el bus master: tabla PRD, dirección y estado limpio
+    outb(ch->bmide + IDE_BM_CMD, 0);
+    outl(ch->bmide + IDE_BM_PRDT, (u32)ch->prdt);
+    outb(ch->bmide + IDE_BM_STATUS, IDE_BM_STATUS_IRQ | IDE_BM_STATUS_ERR);
+    
+    // Configurar parámetros de la transferencia
+    ide_setup_lba(drive, lba, num_sectors, lba48);
+    
+    if (lba48) {
+        cmd = write ? IDE_CMD_WRITE_DMA_EXT : IDE_CMD_READ_DMA_EXT;
+    } else {
+        cmd = write ? IDE_CMD_WRITE_DMA : IDE_CMD_READ_DMA;
+    }
+    
+    ide_irq_arm(ch);
+    outb(ch->base + IDE_CMD, cmd);
+    
+    // Arrancar el motor: el bit READ indica escritura en memoria
+    outb(ch->bmide + IDE_BM_CMD,
+         IDE_BM_CMD_START | (write ? 0 : IDE_BM_CMD_READ));
+    
+    return 0;
+}
+
+// Transferencia DMA síncrona: arrancar y esperar el fin
+static int ide_dma_transfer(int drive, u32 lba, u32 num_sectors,
+                            struct blk_seg *sg, int nsg, int write) {
+    if (ide_dma_start(drive, lba, num_sectors, sg, nsg, write)) return -1;
+    return ide_dma_wait(&ide_channels[IDE_CHANNEL(drive)]);
+}
+
+// El DMA necesita bus master, soporte en la unidad y buffers alineados a palabra
+static int ide_dma_usable(int drive, const void *buffer) {
+    return ide_channels[IDE_CHANNEL(drive)].bmide != 0 &&
+           ide_drives[drive].dma && !((u32)buffer & 1);
+}
+
+// Elegir el comando PIO: MULTIPLE si la unidad lo aceptó, EXT si hace falta
+static u8 ide_pio_command(struct ide_drive *d, int lba48, int write) {
+    if (d->multiple) {
+        if (lba48) return write ? IDE_CMD_WRITE_MULTIPLE_EXT : IDE_CMD_READ_MULTIPLE_EXT;
+        return write ? IDE_CMD_WRITE_MULTIPLE : IDE_CMD_READ_MULTIPLE;
+    }
+    if (lba48) return write ? IDE_CMD_WRITE_EXT : IDE_CMD_READ_EXT;
+    return write ? IDE_CMD_WRITE : IDE_CMD_READ;
+}
+
+/*
+ * Transferencia PIO de un solo comando. En modo MULTIPLE el disco pide
+ * datos (DRQ) e interrumpe una vez por bloque de 'multiple' sectores.
+ */
+static int ide_pio_transfer(int drive, u32 lba, u32 num_sectors, void *buffer, int write) {
+    struct ide_drive *d = &ide_drives[drive];
+    struct ide_channel *ch = &ide_channels[IDE_CHANNEL(drive)];
+    int lba48 = ide_needs_lba48(lba, num_sectors);
+    u32 block = d->multiple ? d->multiple : 1;
+    u32 *buf = (u32 *)buffer;
+    u32 left = num_sectors;
+    u32 n;
+    
     // Esperar a que el disco esté listo
-    if (ide_wait(1)) return -1;
-    
-    // Configurar parámetros de escritura
-    outb(IDE_DRIVE_HEAD, 0xE0 | (drive << 4) | ((lba >> 24) & 0x0F));
-    outb(IDE_SECT_COUNT, num_sectors);
-    outb(IDE_SECT_NUM, lba & 0xFF);
-    outb(IDE_CYL_LOW, (lba >> 8) & 0xFF);
-    outb(IDE_CYL_HIGH, (lba >> 16) & 0xFF);
-    
-    // Enviar comando de escritura
-    outb(IDE_CMD, IDE_CMD_WRITE);
-    
-    // Escribir datos sector por sector
-    for (i = 0; i < num_sectors; i++) {
-        // Esperar hasta que el disco esté listo para recibir datos
-        if (ide_wait(1)) return -1;
+    if (ide_wait(ch, 1)) return -1;
+    
+    ide_setup_lba(drive, lba, num_sectors, lba48);
+    
+    ide_irq_arm(ch);
+    outb(ch->base + IDE_CMD, ide_pio_command(d, lba48, write));
+    
+    // En escritura el primer bloque no genera IRQ: esperar DRQ por polling
+    if (write && ide_wait(ch, 1)) return -1;
+    
+    while (left > 0) {
+        n = (left < block) ? left : block;
+        
+        if (write) {
+            // Escribir el bloque; la IRQ llega cuando quedó escrito
+            ide_irq_arm(ch);
+            outsl(ch->base + IDE_DATA, buf, n * 128);
+            if (ide_wait_irq(ch)) return -1;
+        } else {
+            // Dormir hasta que el disco avise que el bloque está listo
+            if (ide_wait_irq(ch)) return -1;
+            ide_irq_arm(ch);
+            insl(ch->base + IDE_DATA, buf, n * 128);
+        }
         
-        // Escribir 256 palabras (512 bytes)
-        outsl(IDE_DATA, buf, 128);
-        buf += 256;
+        buf += n * 128;
+        left -= n;
     }
     
-    // Esperar a que la escritura se complete
-    if (ide_wait(1)) return -1;
+    return 0;
+}
+
+/*
+ * Leer o escribir cualquier número de sectores. La petición se parte en
+ * comandos de hasta 256 (LBA28) o 65536 (LBA48) sectores; cada comando
+ * va por DMA si es posible y por PIO si no.
+ */
+static int ide_rw(int drive, u32 lba, u32 num_sectors, void *buffer, int write) {
+    struct ide_drive *d;
+    u32 max;
+    u8 *buf = (u8 *)buffer;
+    struct blk_seg sg;
+    u32 n;
+    
+    if (drive < 0 || drive >= IDE_MAX_DRIVES || !ide_drives[drive].present) return -1;
+    d = &ide_drives[drive];
+    max = d->lba48 ? IDE_LBA48_MAX_COUNT : IDE_LBA28_MAX_COUNT;
+    
+    while (num_sectors > 0) {
+        n = (num_sectors < max) ? num_sectors : max;
+        
+        if (ide_dma_usable(drive, buf)) {
+            // Un buffer sin alinear a 64KB gasta una entrada PRD extra
+            if (n > IDE_DMA_MAX_COUNT) n = IDE_DMA_MAX_COUNT;
+            sg.buf = buf;
+            sg.count = n;
+            if (ide_dma_transfer(drive, lba, n, &sg, 1, write) != 0) {
+                print("IDE    : falling back to PIO\n");
+                if (ide_pio_transfer(drive, lba, n, buf, write)) return -1;
+            }
+        } else if (ide_pio_transfer(drive, lba, n, buf, write)) {
+            return -1;
+        }
+        
+        lba += n;
+        buf += n * 512;
+        num_sectors -= n;
+    }
     
     return 0;
 }
 
-// Identificar dispositivo IDE
+// Leer sectores del disco (unidad 0..3)
+int ide_read_sectors(int drive, u32 lba, u32 num_sectors, void *buffer) {
+    return ide_rw(drive, lba, num_sectors, buffer, 0);
+}
+
+// Escribir sectores en el disco (unidad 0..3)
+int ide_write_sectors(int drive, u32 lba, u32 num_sectors, void *buffer) {
+    return ide_rw(drive, lba, num_sectors, buffer, 1);
+}
+
+/*
+ * Ejecutar un comando de la cola de bloques de forma síncrona. Los
+ * segmentos fusionados van en un único comando DMA si todos están
+ * alineados; si no, cada segmento es una transferencia aparte.
+ */
+static int ide_rw_request(int drive, struct blk_request *rq) {
+    u32 lba = rq->lba;
+    int dma = 1;
+    int i;
+    
+    if (rq->nseg == 1) {
+        return ide_rw(drive, lba, rq->count, rq->segs[0].buf, rq->write);
+    }
+    
+    for (i = 0; i < rq->nseg; i++) {
+        if (!ide_dma_usable(drive, rq->segs[i].buf)) dma = 0;
+    }
+    if (dma && ide_dma_transfer(drive, lba, rq->count, rq->segs, rq->nseg, rq->write) == 0) {
+        return 0;
+    }
+    
+    for (i = 0; i < rq->nseg; i++) {
+        if (ide_rw(drive, lba, rq->segs[i].count, rq->segs[i].buf, rq->write)) return -1;
+        lba += rq->segs[i].count;
+    }
+    return 0;
+}
+
+// Repetir un comando por PIO, segmento a segmento (tras un error de DMA)
+static int ide_pio_request(int drive, struct blk_request *rq) {
+    u32 lba = rq->lba;
+    int i;
+    
+    for (i = 0; i < rq->nseg; i++) {
+        if (ide_pio_transfer(drive, lba, rq->segs[i].count, rq->segs[i].buf, rq->write)) return -1;
+        lba += rq->segs[i].count;
+    }
+    return 0;
+}
+
+// La otra unidad del canal pudo quedarse en BLK_BUSY: relanzar su cola
+static void ide_run_sibling(int drive) {
+    struct blockdev *dev = &ide_blockdevs[drive ^ 1];
+    
+    if (dev->submit) {
+        blockdev_run_queue(dev);
+    }
+}
+
+/*
+ * Fin de un comando DMA asíncrono (desde la IRQ o el poll, con IF=0).
+ * Solo para el bus master y deja el comando en ch->finished: el canal
+ * sigue ocupado hasta que ide_dma_complete lo termina fuera de la IRQ.
+ */
+static void ide_dma_finish(struct ide_channel *ch) {
+    u8 status = inb(ch->base + IDE_STATUS);     // confirma la IRQ
+    
+    ch->dma_error = (ide_dma_stop(ch) & IDE_BM_STATUS_ERR) || (status & IDE_STATUS_ERR);
+    ch->finished = ch->active;
+    ch->active = NULL;
+}
+
+/*
+ * Completar el DMA recogido de un canal, desde el bottom half o desde el
+ * poll del que espera. Si el bus master falló se repite por PIO; esa
+ * repetición y los comandos síncronos que lance la cola no pueden
+ * ejecutarse en la IRQ, con las interrupciones deshabilitadas.
+ */
+static void ide_dma_complete(struct ide_channel *ch) {
+    u32 flags = ide_irq_save();
+    struct blk_request *rq = ch->finished;
+    int drive = ide_active_drive[ch - ide_channels];
+    int err = 0;
+    
+    ch->finished = NULL;
+    ide_irq_restore(flags);
+    if (rq == NULL) {
+        return;
+    }
+    
+    if (ch->dma_error) {
+        print("IDE    : DMA transfer error, falling back to PIO\n");
+        err = ide_pio_request(drive, rq);
+    }
+    
+    ch->busy = 0;
+    blockdev_complete(rq, err);
+    ide_run_sibling(drive);
+}
+
+static void ide_dma_bh(void) {
+    int i;
+    
+    for (i = 0; i < IDE_CHANNELS; i++) {
+        ide_dma_complete(&ide_channels[i]);
+    }
+}
+
+/*
+ * Operación submit. Un canal ejecuta un comando cada vez: si la otra
+ * unidad lo ocupa se devuelve BLK_BUSY. Con todos los segmentos aptos
+ * para DMA el comando queda en vuelo y lo termina la IRQ, así los dos
+ * canales trabajan a la vez; si no, se ejecuta síncrono antes de volver.
+ */
+static int ide_blk_submit(struct blockdev *dev, struct blk_request *rq) {
+    int drive = (int)dev->priv;
+    struct ide_channel *ch = &ide_channels[IDE_CHANNEL(drive)];
+    u32 flags = ide_irq_save();
+    int status;
+    int i;
+    
+    if (ch->busy) {
+        ide_irq_restore(flags);
+        return BLK_BUSY;
+    }
+    ch->busy = 1;
+    
+    status = (rq->nseg > 0 && ide_bh >= 0);
+    for (i = 0; i < rq->nseg; i++) {
+        if (!ide_dma_usable(drive, rq->segs[i].buf)) status = 0;
+    }
+    if (status) {
+        ch->active = rq;
+        ide_active_drive[IDE_CHANNEL(drive)] = drive;
+        if (ide_dma_start(drive, rq->lba, rq->count, rq->segs, rq->nseg, rq->write) == 0) {
+            ide_irq_restore(flags);
+            return BLK_OK;
+        }
+        ch->active = NULL;
+    }
+    ide_irq_restore(flags);
+    
+    status = ide_rw_request(drive, rq);
+    ch->busy = 0;
+    blockdev_complete(rq, status);
+    ide_run_sibling(drive);
+    return BLK_OK;
+}
+
+// Operación poll: recoge un DMA terminado sin esperar a la IRQ
+static void ide_blk_poll(struct blockdev *dev) {
+    struct ide_channel *ch = &ide_channels[IDE_CHANNEL((int)dev->priv)];
+    u32 flags = ide_irq_save();
+    
+    if (ch->active && ide_dma_done(ch)) {
+        ide_dma_finish(ch);
+    }
+    ide_irq_restore(flags);
+    ide_dma_complete(ch);
+}
+
+/*
+ * Identificar la unidad (0..3) por polling. Devuelve -1 sin mensajes si
+ * la posición está vacía o no es un disco ATA (ATAPI responde con una
+ * firma en los registros de cilindro y aborta el comando).
+ */
 int ide_identify(int drive, u16 *buffer) {
-    // Esperar a que el disco esté listo
-    if (ide_wait(1)) return -1;
+    struct ide_channel *ch;
+    u8 status;
+    int i;
+    
+    if (drive < 0 || drive >= IDE_MAX_DRIVES) return -1;
+    ch = &ide_channels[IDE_CHANNEL(drive)];
+    if (!ch->present) return -1;
+    
+    // Esperar a que el canal esté libre
+    if (ide_wait(ch, 0)) return -1;
     
     // Configurar parámetros de identificación
-    outb(IDE_DRIVE_HEAD, 0xE0 | (drive << 4));
-    outb(IDE_SECT_COUNT, 0);
-    outb(IDE_SECT_NUM, 0);
-    outb(IDE_CYL_LOW, 0);
-    outb(IDE_CYL_HIGH, 0);
+    outb(ch->base + IDE_DRIVE_HEAD, 0xE0 | (IDE_UNIT(drive) << 4));
+    ide_delay(ch);
+    outb(ch->base + IDE_SECT_COUNT, 0);
+    outb(ch->base + IDE_SECT_NUM, 0);
+    outb(ch->base + IDE_CYL_LOW, 0);
+    outb(ch->base + IDE_CYL_HIGH, 0);
     
     // Enviar comando IDENTIFY
-    outb(IDE_CMD, IDE_CMD_IDENTIFY);
+    ide_irq_arm(ch);
+    outb(ch->base + IDE_CMD, IDE_CMD_IDENTIFY);
+    ide_delay(ch);
+    
+    // Estado 0: no hay unidad en esta posición
+    status = inb(ch->base + IDE_STATUS);
+    if (status == 0 || status == 0xFF) return -1;
+    
+    for (i = 0; (status & IDE_STATUS_BSY) && i < IDE_PROBE_TIMEOUT; i++) {
+        status = inb(ch->base + IDE_STATUS);
+    }
+    if (status & IDE_STATUS_BSY) return -1;
+    
+    if (inb(ch->base + IDE_CYL_LOW) || inb(ch->base + IDE_CYL_HIGH)) return -1;
     
-    // Esperar respuesta
-    if (ide_wait(1)) return -1;
+    for (i = 0; !(status & (IDE_STATUS_DRQ | IDE_STATUS_ERR)) && i < IDE_PROBE_TIMEOUT; i++) {
+        status = inb(ch->base + IDE_STATUS);
+    }
+    if (!(status & IDE_STATUS_DRQ) || (status & IDE_STATUS_ERR)) return -1;
     
     // Leer datos de identificación (256 palabras = 512 bytes)
-    insl(IDE_DATA, buffer, 128);
+    insl(ch->base + IDE_DATA, buffer, 128);
     
     return 0;
 }
@@ -2,36 +2,131 @@
 #define IDE_H
 
 #include "types.h"
+#include "blockdev.h"
 
-// Puertos del controlador IDE primario
-#define IDE_DATA        0x1F0
-#define IDE_ERROR       0x1F1
-#define IDE_SECT_COUNT  0x1F2
-#define IDE_SECT_NUM    0x1F3
-#define IDE_CYL_LOW     0x1F4
-#define IDE_CYL_HIGH    0x1F5
-#define IDE_DRIVE_HEAD  0x1F6
-#define IDE_STATUS      0x1F7
-#define IDE_CMD         0x1F7
+// Canales ATA legacy: bloque de comandos, registro de control e IRQ
+#define IDE_PRIMARY_BASE    0x1F0
+#define IDE_PRIMARY_CTRL    0x3F6
+#define IDE_PRIMARY_IRQ     14
+#define IDE_SECONDARY_BASE  0x170
+#define IDE_SECONDARY_CTRL  0x376
+#define IDE_SECONDARY_IRQ   15
+#define IDE_CHANNELS        2
+
+// Registros (desplazamientos sobre la base del canal)
+#define IDE_DATA        0
+#define IDE_ERROR       1
+#define IDE_SECT_COUNT  2
+#define IDE_SECT_NUM    3
+#define IDE_CYL_LOW     4
+#define IDE_CYL_HIGH    5
+#define IDE_DRIVE_HEAD  6
+#define IDE_STATUS      7
+#define IDE_CMD         7
+// Sobre el registro de control del canal
+#define IDE_CONTROL     0       // escritura: registro de control
+#define IDE_ALT_STATUS  0       // lectura: estado sin confirmar la IRQ
+
+// Bits del registro de control
+#define IDE_CTRL_NIEN   0x02    // 1 = interrupciones deshabilitadas
+
+#define IDE_IRQ_TIMEOUT 200     // despertares sin IRQ antes de volver a polling
+#define IDE_PROBE_TIMEOUT 100000 // lecturas de estado al identificar
 
 // Bits del registro de estado
 #define IDE_STATUS_ERR  0x01
 #define IDE_STATUS_DRQ  0x08
+#define IDE_STATUS_DRDY 0x40
 #define IDE_STATUS_BSY  0x80
 
 // Comandos
 #define IDE_CMD_READ    0x20
 #define IDE_CMD_WRITE   0x30
 #define IDE_CMD_IDENTIFY 0xEC
+#define IDE_CMD_READ_DMA  0xC8
+#define IDE_CMD_WRITE_DMA 0xCA
+#define IDE_CMD_READ_MULTIPLE  0xC4
+#define IDE_CMD_WRITE_MULTIPLE 0xC5
+#define IDE_CMD_SET_MULTIPLE   0xC6
+
+// Comandos LBA48 (EXT)
+#define IDE_CMD_READ_EXT           0x24
+#define IDE_CMD_WRITE_EXT          0x34
+#define IDE_CMD_READ_DMA_EXT       0x25
+#define IDE_CMD_WRITE_DMA_EXT      0x35
+#define IDE_CMD_READ_MULTIPLE_EXT  0x29
+#define IDE_CMD_WRITE_MULTIPLE_EXT 0x39
+
+// Límites por comando
+#define IDE_LBA28_LIMIT      0x10000000 // primer sector no direccionable con LBA28
+#define IDE_LBA28_MAX_COUNT  256
+#define IDE_LBA48_MAX_COUNT  65536
+
+// Registros bus master (desplazamientos sobre BAR4; el secundario +8)
+#define IDE_BM_SECONDARY 0x08
+#define IDE_BM_CMD      0x00
+#define IDE_BM_STATUS   0x02
+#define IDE_BM_PRDT     0x04
+
+#define IDE_BM_CMD_START     0x01
+#define IDE_BM_CMD_READ      0x08   // el dispositivo escribe en memoria
+#define IDE_BM_STATUS_ACTIVE 0x01
+#define IDE_BM_STATUS_ERR    0x02
+#define IDE_BM_STATUS_IRQ    0x04
+
+// Tabla PRD (Physical Region Descriptors)
+#define IDE_PRD_ENTRIES 512     // 512 * 64KB = 32MB por comando
+#define IDE_PRDT_ALIGN  4096    // la tabla no puede cruzar un límite de 64KB
+#define IDE_PRD_EOT     0x8000
+#define IDE_DMA_MAX_COUNT ((IDE_PRD_ENTRIES - 1) * 128)
+
+struct ide_prd {
+    u32 addr;       // dirección física del buffer
+    u16 bytes;      // bytes a transferir (0 = 64KB)
+    u16 flags;      // bit 15: última entrada
+} __attribute__((packed));
 
 // Tipos de unidad
 #define IDE_MASTER      0
 #define IDE_SLAVE       1
 
+// Unidades 0..3: hda/hdb en el canal primario, hdc/hdd en el secundario
+#define IDE_MAX_DRIVES      4
+#define IDE_CHANNEL(drive)  (((drive) >> 1) & 1)
+#define IDE_UNIT(drive)     ((drive) & 1)
+
+// Capacidades de una unidad, leídas con IDENTIFY
+struct ide_drive {
+    u8 present;
+    u8 dma;         // palabra 49, bit 8
+    u8 lba48;       // palabra 83, bit 10
+    u8 multiple;    // sectores por bloque de READ/WRITE MULTIPLE (0 = no)
+    u32 sectors;    // capacidad total
+};
+
+// Estado de un canal: las dos unidades comparten registros, IRQ y DMA
+struct ide_channel {
+    u16 base;
+    u16 ctrl;
+    u8 irq;
+    u8 present;
+    u16 bmide;                      // 0 = sin DMA, solo PIO
+    struct ide_prd *prdt;           // tabla PRD del canal
+    volatile u8 irq_pending;        // IRQ recibida en una espera síncrona
+    volatile u8 irq_status;
+    volatile u8 busy;               // un comando ocupa el canal
+    struct blk_request *active;     // comando DMA asíncrono en curso
+    struct blk_request *finished;   // DMA parado, pendiente de completar
+    u8 dma_error;                   // el bus master falló: repetir por PIO
+};
+
 // Prototipos de funciones
 void ide_init(void);
-int ide_read_sectors(int drive, u32 lba, u8 num_sectors, void *buffer);
-int ide_write_sectors(int drive, u32 lba, u8 num_sectors, void *buffer);
+int ide_read_sectors(int drive, u32 lba, u32 num_sectors, void *buffer);
+int ide_write_sectors(int drive, u32 lba, u32 num_sectors, void *buffer);
 int ide_identify(int drive, u16 *buffer);
+u32 ide_get_sectors(int drive);
+void isr_ide_int(void);
+void isr_ide_secondary_int(void);
 
 #endif
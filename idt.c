@@ -35,6 +35,13 @@ void init_idt(void)
     /* Interrupciones específicas */
     init_idt_desc(0x08, (u32)_asm_irq_0, 0x8E00, &kidt[32]);     /* IRQ0 - reloj */
     init_idt_desc(0x08, (u32)_asm_irq_1, 0x8E00, &kidt[33]);     /* IRQ1 - teclado */
+    init_idt_desc(0x08, (u32)_asm_irq_14, 0x8E00, &kidt[0x76]);  /* IRQ14 - disco IDE (esclavo base 0x70) */
+    
+    /* Resto de líneas IRQ: despacho a los drivers registrados */
+    for (i = 0; i < 16; i++) {
+        if (_asm_irq_table[i])
+            init_idt_desc(0x08, _asm_irq_table[i], 0x8E00, &kidt[IRQ_VECTOR(i)]);
+    }
     
     /* Excepciones del procesador */
     init_idt_desc(0x08, (u32)_asm_exc_GP, 0x8E00, &kidt[13]);    /* General Protection Fault */
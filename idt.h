@@ -37,9 +37,27 @@ void init_idt(void);
 extern void _asm_default_int(void);
 extern void _asm_irq_0(void);
 extern void _asm_irq_1(void);
+extern void _asm_irq_14(void);
+extern u32 _asm_irq_table[16];
 extern void _asm_exc_GP(void);
 extern void _asm_exc_PF(void);
 
+/* Vectores de las IRQ según la programación del PIC (pic.c) */
+#define IRQ_VECTOR(irq) ((irq) < 8 ? 0x20 + (irq) : 0x70 + (irq) - 8)
+
+/* Manejadores de IRQ registrados por drivers (líneas compartidas) */
+#define IRQ_MAX_HANDLERS 4
+int irq_install_handler(int irq, void (*handler)(void));
+void isr_irq_dispatch(int irq);
+
+/* Trabajo diferido: se ejecuta al salir de la IRQ, ya con el EOI enviado
+   y las interrupciones habilitadas, o antes si se llama a bh_run() */
+#define BH_MAX 8
+int bh_install(void (*handler)(void));
+void bh_raise(int bh);
+void bh_run(void);
+void isr_bottom_half(void);
+
 /* Prototipos de rutinas de llamadas al sistema */
 extern void _asm_syscalls(void);
 
@@ -5,6 +5,9 @@
 extern isr_default_int
 extern isr_clock_int
 extern isr_kbd_int
+extern isr_ide_int
+extern isr_irq_dispatch
+extern isr_bottom_half
 extern do_syscalls
 extern page_fault_handler
 
@@ -57,6 +60,57 @@ _asm_irq_1:
     RESTORE_REGS
     iret
 
+; Rutina de interrupción para IRQ14 (disco IDE primario, PIC esclavo)
+global _asm_irq_14
+_asm_irq_14:
+    SAVE_REGS
+    call isr_ide_int
+    mov al, 0x20    ; EOI al PIC esclavo y luego al maestro
+    out 0xA0, al
+    out 0x20, al
+    call isr_bottom_half
+    RESTORE_REGS
+    iret
+
+; Rutinas para las demás líneas IRQ: llaman a los manejadores que
+; registraron los drivers (isr_irq_dispatch) y confirman al PIC
+%macro  IRQ_STUB 1
+global _asm_irq_%1
+_asm_irq_%1:
+    SAVE_REGS
+    push %1
+    call isr_irq_dispatch
+    add esp, 4
+    mov al, 0x20    ; EOI
+%if %1 >= 8
+    out 0xA0, al    ; esclavo primero
+%endif
+    out 0x20, al
+    call isr_bottom_half    ; trabajo diferido, ya con el PIC confirmado
+    RESTORE_REGS
+    iret
+%endmacro
+
+IRQ_STUB 2
+IRQ_STUB 3
+IRQ_STUB 4
+IRQ_STUB 5
+IRQ_STUB 6
+IRQ_STUB 7
+IRQ_STUB 8
+IRQ_STUB 9
+IRQ_STUB 10
+IRQ_STUB 11
+IRQ_STUB 12
+IRQ_STUB 13
+IRQ_STUB 15
+
+; Tabla de rutinas por línea (0 = la línea tiene su propia entrada)
+global _asm_irq_table
+_asm_irq_table:
+    dd 0, 0, _asm_irq_2, _asm_irq_3, _asm_irq_4, _asm_irq_5, _asm_irq_6, _asm_irq_7
+    dd _asm_irq_8, _asm_irq_9, _asm_irq_10, _asm_irq_11, _asm_irq_12, _asm_irq_13, 0, _asm_irq_15
+
 ; Rutina de interrupción para General Protection Fault
 global _asm_exc_GP
 _asm_exc_GP:
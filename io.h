@@ -22,4 +22,26 @@
         _v;     \
 })
 
+/* escribe una palabra de 16 bits en un puerto */
+#define outw(port,value) \
+        asm volatile ("outw %%ax, %%dx" :: "d" (port), "a" (value));
+
+/* lee una palabra de 16 bits de un puerto */
+#define inw(port) ({    \
+        unsigned short _v;      \
+        asm volatile ("inw %%dx, %%ax" : "=a" (_v) : "d" (port)); \
+        _v;     \
+})
+
+/* escribe una doble palabra de 32 bits en un puerto */
+#define outl(port,value) \
+        asm volatile ("outl %%eax, %%dx" :: "d" (port), "a" (value));
+
+/* lee una doble palabra de 32 bits de un puerto */
+#define inl(port) ({    \
+        unsigned int _v;        \
+        asm volatile ("inl %%dx, %%eax" : "=a" (_v) : "d" (port)); \
+        _v;     \
+})
+
 #endif
@@ -3,12 +3,124 @@
 #include "io.h"
 #include "kbd.h"
 #include "process.h"
+#include "idt.h"
+
+/* Manejadores registrados por los drivers para cada línea IRQ */
+static void (*irq_handlers[16][IRQ_MAX_HANDLERS])(void);
+
+/* Trabajo diferido (bottom halves) pendiente, un bit por manejador */
+static void (*bh_handlers[BH_MAX])(void);
+static volatile u32 bh_pending = 0;
+static volatile int bh_running = 0;     /* contexto de bottom half: sin cambio de tarea */
 
 void isr_default_int(void)
 {
     print("interrupt\n");
 }
 
+/*
+ * Registra un manejador para una línea IRQ. Las líneas PCI pueden estar
+ * compartidas, así que cada manejador debe comprobar su dispositivo.
+ */
+int irq_install_handler(int irq, void (*handler)(void))
+{
+    int i;
+
+    if (irq < 0 || irq >= 16 || _asm_irq_table[irq] == 0)
+        return -1;
+
+    for (i = 0; i < IRQ_MAX_HANDLERS; i++) {
+        if (irq_handlers[irq][i] == 0) {
+            irq_handlers[irq][i] = handler;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Llamada desde _asm_irq_N: ejecuta los manejadores de la línea */
+void isr_irq_dispatch(int irq)
+{
+    int i;
+
+    for (i = 0; i < IRQ_MAX_HANDLERS; i++) {
+        if (irq_handlers[irq][i])
+            irq_handlers[irq][i]();
+    }
+}
+
+/*
+ * Registra un manejador de trabajo diferido y devuelve su número, que se
+ * pasa a bh_raise(). Se ejecuta fuera de la IRQ que lo pidió.
+ */
+int bh_install(void (*handler)(void))
+{
+    int i;
+
+    for (i = 0; i < BH_MAX; i++) {
+        if (bh_handlers[i] == 0) {
+            bh_handlers[i] = handler;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Marca un bottom half como pendiente (desde una IRQ o con cli) */
+void bh_raise(int bh)
+{
+    asm volatile("lock; orl %1, %0" : "+m" (bh_pending) : "r" (1 << bh) : "memory");
+}
+
+/*
+ * Ejecuta los bottom halves pendientes. Se entra con IF=0; los manejadores
+ * corren con las interrupciones como indica 'irqs', pero sin cambios de
+ * tarea (ver isr_clock_int). Si ya se están ejecutando más abajo en la
+ * pila, ese bucle recogerá lo nuevo.
+ */
+static void bh_process(int irqs)
+{
+    u32 pending;
+    int i;
+
+    if (bh_running)
+        return;
+    bh_running = 1;
+
+    while ((pending = bh_pending) != 0) {
+        bh_pending = 0;
+        if (irqs)
+            asm volatile("sti");
+        for (i = 0; i < BH_MAX; i++) {
+            if ((pending & (1 << i)) && bh_handlers[i])
+                bh_handlers[i]();
+        }
+        asm volatile("cli");
+    }
+
+    bh_running = 0;
+}
+
+/* Llamada desde _asm_irq_N tras el EOI: el trabajo diferido admite IRQ */
+void isr_bottom_half(void)
+{
+    if (bh_pending)
+        bh_process(1);
+}
+
+/* Ejecuta ya los bottom halves pendientes desde el código normal */
+void bh_run(void)
+{
+    u32 flags;
+
+    if (!bh_pending)
+        return;
+
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags) :: "memory");
+    bh_process((flags & 0x200) != 0);
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+}
+
 void isr_clock_int(void)
 {
     static int tic = 0;
@@ -30,8 +142,10 @@ void isr_clock_int(void)
         }
     }
     
-    /* Llamar al scheduler solo si hay tareas cargadas */
-    if (n_proc > 0) {
+    /* Llamar al scheduler solo si hay tareas cargadas. Dentro de un
+       bottom half no: la tarea se llevaría el bucle a medias y bh_running
+       activo. El cambio queda para el siguiente tic */
+    if (n_proc > 0 && !bh_running) {
         schedule();
     }
 }
@@ -0,0 +1,405 @@
+#include "journal.h"
+#include "lib.h"
+#include "mm.h"
+#include "screen.h"
+
+/*
+ * Transacción en curso: bloques de metadatos de la caché ya modificados
+ * (y marcados sucios). Se les mantiene una referencia para que la caché
+ * no los escriba en su sitio antes de que estén en el diario.
+ */
+static struct blockdev *journal_dev = NULL;
+static u32 journal_start;
+static u32 journal_sectors;
+static u32 journal_head;                /* siguiente sector libre del diario */
+static u32 journal_seq;                 /* número de la siguiente transacción */
+static struct bcache_buf *journal_txn[JOURNAL_TXN_BLOCKS];
+static u32 journal_count;
+static struct journal_revoke journal_revokes[JOURNAL_REVOKES];
+static u32 journal_nrevoke;
+static u8 *journal_buf = NULL;          /* descriptor + bloques, contiguos */
+
+struct journal_stats journal_stats;
+
+/* Asociar el diario a su zona y reservar el buffer de escritura */
+static int journal_attach(struct blockdev *dev, u32 start, u32 sectors)
+{
+    if (sectors < 2 + 2 * (1 + JOURNAL_TXN_BLOCKS))
+        return -1;
+    if (journal_buf == NULL)
+        journal_buf = (u8 *)kmalloc_aligned((1 + JOURNAL_TXN_BLOCKS) * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+    if (journal_buf == NULL) {
+        print("journal: ERROR - Cannot allocate journal buffer\n");
+        return -1;
+    }
+
+    journal_dev = dev;
+    journal_start = start;
+    journal_sectors = sectors;
+    journal_head = 1;
+    journal_count = 0;
+    journal_nrevoke = 0;
+    memset(&journal_stats, 0, sizeof(journal_stats));
+    return 0;
+}
+
+/* Escribir la cabecera: las transacciones anteriores a 'seq' dejan de valer */
+static int journal_write_header(u32 seq)
+{
+    struct journal_header *h = (struct journal_header *)journal_buf;
+
+    memset(journal_buf, 0, BCACHE_BLOCK_SIZE);
+    h->magic = JOURNAL_MAGIC;
+    h->seq = seq;
+    return blockdev_write(journal_dev, journal_start, 1, journal_buf);
+}
+
+/* Diario vacío en una zona recién formateada */
+int journal_format(struct blockdev *dev, u32 start, u32 sectors)
+{
+    if (journal_attach(dev, start, sectors) != 0)
+        return -1;
+
+    journal_seq = 1;
+    if (journal_write_header(journal_seq) != 0) {
+        journal_dev = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Comprobar destinos y crc de una transacción ya leída en journal_buf */
+static int journal_valid(struct journal_desc *d)
+{
+    u32 crc, i;
+
+    if (d->nrevoke > JOURNAL_REVOKES)
+        return 0;
+    for (i = 0; i < d->count; i++) {
+        if (d->lba[i] >= journal_dev->sectors)
+            return 0;
+    }
+
+    crc = d->crc;
+    d->crc = 0;
+    if (crc32c(0, journal_buf, (1 + d->count) * BCACHE_BLOCK_SIZE) != crc)
+        return 0;
+    d->crc = crc;
+    return 1;
+}
+
+/*
+ * Leer y validar en journal_buf la transacción 'seq' que empieza en el
+ * sector 'pos' del diario. Devuelve 0 si es válida.
+ */
+static int journal_read_txn(u32 pos, u32 seq)
+{
+    struct journal_desc *d = (struct journal_desc *)journal_buf;
+
+    if (pos + 1 >= journal_sectors ||
+        blockdev_read(journal_dev, journal_start + pos, 1, journal_buf) != 0 ||
+        d->magic != JOURNAL_MAGIC || d->seq != seq ||
+        (d->count == 0 && d->nrevoke == 0) || d->count > JOURNAL_TXN_BLOCKS ||
+        pos + 1 + d->count > journal_sectors)
+        return -1;
+    if (d->count > 0 && blockdev_read(journal_dev, journal_start + pos + 1, d->count,
+                                      journal_buf + BCACHE_BLOCK_SIZE) != 0)
+        return -1;
+    return journal_valid(d) ? 0 : -1;
+}
+
+/* ¿Lo revoca una transacción posterior a 'seq'? */
+static int journal_is_revoked(struct journal_revoke *rv, u32 *rv_seq, u32 nrv, u32 lba, u32 seq)
+{
+    u32 i;
+
+    for (i = 0; i < nrv; i++) {
+        if (rv_seq[i] > seq && lba >= rv[i].start && lba - rv[i].start < rv[i].count)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Al montar: reproducir en orden las transacciones confirmadas desde la
+ * cabecera, escribiendo cada bloque en su sitio (y en la caché si está),
+ * y dejar el diario vacío. Una primera pasada recoge las revocaciones:
+ * no se escribe una copia revocada más adelante. Devuelve las
+ * transacciones reproducidas o -1 si la zona no tiene un diario.
+ */
+int journal_replay(struct blockdev *dev, u32 start, u32 sectors)
+{
+    struct journal_header *h = (struct journal_header *)journal_buf;
+    struct journal_desc *d = (struct journal_desc *)journal_buf;
+    struct journal_revoke *rv = NULL;
+    u32 *rv_seq = NULL;
+    u32 nrv = 0;
+    u32 first, pos;
+    int n = 0;
+    int k;
+    u32 i;
+
+    if (journal_attach(dev, start, sectors) != 0)
+        return -1;
+
+    if (blockdev_read(dev, start, 1, journal_buf) != 0 || h->magic != JOURNAL_MAGIC) {
+        journal_dev = NULL;
+        return -1;
+    }
+    first = h->seq;
+
+    // Primera pasada: cuántas transacciones son válidas y qué revocan.
+    // Cada una ocupa al menos un sector
+    for (pos = 1; journal_read_txn(pos, first + n) == 0; pos += 1 + d->count) {
+        if (d->nrevoke > 0 && rv == NULL) {
+            rv = (struct journal_revoke *)kmalloc(sectors * JOURNAL_REVOKES *
+                                                  sizeof(struct journal_revoke));
+            rv_seq = (u32 *)kmalloc(sectors * JOURNAL_REVOKES * sizeof(u32));
+            if (rv == NULL || rv_seq == NULL) {
+                print("journal: ERROR - Cannot allocate revoke table\n");
+                journal_dev = NULL;
+                return -1;
+            }
+        }
+        for (i = 0; i < d->nrevoke; i++) {
+            rv[nrv] = d->revoke[i];
+            rv_seq[nrv++] = d->seq;
+        }
+        n++;
+    }
+
+    // Segunda: escribir en su sitio lo que nadie ha revocado después
+    journal_seq = first;
+    for (k = 0, pos = 1; k < n; k++, pos += 1 + d->count) {
+        if (journal_read_txn(pos, journal_seq) != 0) {
+            print("journal: ERROR - Replay read failed\n");
+            n = -1;
+            break;
+        }
+        for (i = 0; i < d->count; i++) {
+            if (journal_is_revoked(rv, rv_seq, nrv, d->lba[i], journal_seq)) {
+                journal_stats.revoked++;
+                continue;
+            }
+            if (bcache_write_direct(dev, d->lba[i], 1,
+                                    journal_buf + (1 + i) * BCACHE_BLOCK_SIZE) != 0) {
+                print("journal: ERROR - Replay write failed\n");
+                n = -1;
+                break;
+            }
+        }
+        if (n < 0)
+            break;
+        journal_seq++;
+    }
+
+    if (rv) {
+        kfree(rv);
+        kfree(rv_seq);
+    }
+    if (n < 0) {
+        journal_dev = NULL;
+        return -1;
+    }
+
+    // Ya está todo en su sitio: empezar el diario de nuevo
+    if (n > 0 && journal_write_header(journal_seq) != 0) {
+        journal_dev = NULL;
+        return -1;
+    }
+    journal_stats.replayed = n;
+    return n;
+}
+
+/*
+ * Antes de una operación: que quepa entera en la transacción en curso y
+ * que quede sitio en el diario para confirmarla. Es el único sitio donde
+ * se confirma por falta de espacio: una operación nunca queda partida
+ * entre dos transacciones. Aquí nadie retiene bloques de metadatos, así
+ * que se puede hacer el checkpoint.
+ */
+void journal_begin(void)
+{
+    if (journal_dev == NULL)
+        return;
+
+    if (journal_count + JOURNAL_OP_BLOCKS > JOURNAL_TXN_BLOCKS ||
+        journal_nrevoke + JOURNAL_OP_REVOKES > JOURNAL_REVOKES)
+        journal_commit();
+    if (journal_sectors - journal_head < 1 + JOURNAL_TXN_BLOCKS)
+        journal_checkpoint();
+}
+
+/*
+ * Añadir a la transacción un bloque de metadatos ya modificado con
+ * bcache_mark_dirty(). El diario se queda con la referencia del llamador
+ * hasta confirmar; sin diario equivale a bcache_release().
+ */
+void journal_dirty(struct bcache_buf *b)
+{
+    u32 i;
+
+    if (journal_dev == NULL) {
+        bcache_release(b);
+        return;
+    }
+
+    for (i = 0; i < journal_count; i++) {
+        if (journal_txn[i] == b) {
+            bcache_release(b);
+            return;
+        }
+    }
+
+    // No debe pasar (JOURNAL_OP_BLOCKS cubre el peor caso): confirmar aquí
+    // partiría la operación, así que el bloque sigue por la caché sin más
+    if (journal_count == JOURNAL_TXN_BLOCKS) {
+        print("journal: ERROR - Operation exceeds its reservation\n");
+        bcache_release(b);
+        return;
+    }
+    journal_txn[journal_count++] = b;
+}
+
+/*
+ * Un tramo deja de ser metadatos (se libera): las copias que tenga en el
+ * diario no deben reproducirse. Las de la transacción en curso se sacan
+ * de ella; las ya confirmadas las anula el registro de revocación.
+ */
+void journal_revoke(u32 start, u32 count)
+{
+    struct journal_revoke *last;
+    u32 i, j;
+
+    if (journal_dev == NULL || count == 0)
+        return;
+
+    for (i = 0, j = 0; i < journal_count; i++) {
+        if (journal_txn[i]->lba >= start && journal_txn[i]->lba - start < count)
+            bcache_release(journal_txn[i]);
+        else
+            journal_txn[j++] = journal_txn[i];
+    }
+    journal_count = j;
+
+    // Sin registros confirmados que anular no hace falta revocar
+    if (journal_head == 1 && journal_nrevoke == 0)
+        return;
+
+    last = journal_nrevoke ? &journal_revokes[journal_nrevoke - 1] : NULL;
+    if (last && last->start + last->count == start) {
+        last->count += count;
+        return;
+    }
+    if (journal_nrevoke == JOURNAL_REVOKES) {
+        // No debe pasar (JOURNAL_OP_REVOKES): mejor no reproducir nada viejo
+        print("journal: ERROR - Too many revoked ranges, checkpoint needed\n");
+        return;
+    }
+    journal_revokes[journal_nrevoke].start = start;
+    journal_revokes[journal_nrevoke].count = count;
+    journal_nrevoke++;
+}
+
+/*
+ * Confirmar la transacción en curso: descriptor y copias de los bloques
+ * en un solo comando secuencial. Después los bloques quedan libres para
+ * el write-back normal de la caché.
+ */
+int journal_commit(void)
+{
+    struct journal_desc *d = (struct journal_desc *)journal_buf;
+    u32 count = journal_count;
+    int ret = 0;
+    u32 i;
+
+    if (journal_dev == NULL || (count == 0 && journal_nrevoke == 0))
+        return 0;
+
+    memset(journal_buf, 0, BCACHE_BLOCK_SIZE);
+    d->magic = JOURNAL_MAGIC;
+    d->seq = journal_seq;
+    d->count = count;
+    for (i = 0; i < count; i++) {
+        d->lba[i] = journal_txn[i]->lba;
+        memcpy(journal_buf + (1 + i) * BCACHE_BLOCK_SIZE, journal_txn[i]->data, BCACHE_BLOCK_SIZE);
+    }
+    d->nrevoke = journal_nrevoke;
+    memcpy(d->revoke, journal_revokes, journal_nrevoke * sizeof(struct journal_revoke));
+    d->crc = crc32c(0, journal_buf, (1 + count) * BCACHE_BLOCK_SIZE);
+
+    // Los bloques siguen sucios en la caché: si no se pueden confirmar
+    // solo se pierde la atomicidad
+    if (journal_head + 1 + count > journal_sectors) {
+        print("journal: ERROR - Journal full, committing without it\n");
+        ret = -1;
+    } else if (blockdev_write(journal_dev, journal_start + journal_head, 1 + count, journal_buf) != 0) {
+        print("journal: ERROR - Commit failed\n");
+        ret = -1;
+    } else {
+        journal_head += 1 + count;
+        journal_seq++;
+        journal_stats.commits++;
+        journal_stats.blocks += count;
+    }
+
+    journal_count = 0;
+    journal_nrevoke = 0;
+    for (i = 0; i < count; i++) {
+        bcache_release(journal_txn[i]);
+    }
+    return ret;
+}
+
+/*
+ * Confirmar lo pendiente, escribir todos los bloques sucios en su sitio
+ * y vaciar el diario. No se puede llamar con bloques de metadatos
+ * retenidos. Devuelve los bloques escritos o -1.
+ */
+int journal_checkpoint(void)
+{
+    int written;
+
+    if (journal_dev == NULL)
+        return -1;
+
+    journal_commit();
+    written = bcache_sync(NULL);
+    if (journal_head == 1)
+        return written;
+
+    if (bcache_stats.dirty > 0) {
+        // Queda algo sin escribir (error de E/S): el diario lo cubre aún
+        return written;
+    }
+    if (journal_write_header(journal_seq) != 0) {
+        print("journal: ERROR - Cannot reset journal\n");
+        return -1;
+    }
+    journal_head = 1;
+    journal_stats.checkpoints++;
+    return written;
+}
+
+/* Estadísticas del diario (parte de 'fsstat') */
+void journal_print_stats(void)
+{
+    if (journal_dev == NULL)
+        return;
+
+    print("Journal: ");
+    print_dec(journal_sectors / 2);
+    print("KB, ");
+    print_dec(journal_head - 1);
+    print(" sectors in use\n  Commits: ");
+    print_dec(journal_stats.commits);
+    print("  Blocks: ");
+    print_dec(journal_stats.blocks);
+    print("  Checkpoints: ");
+    print_dec(journal_stats.checkpoints);
+    print("  Replayed: ");
+    print_dec(journal_stats.replayed);
+    print(" (");
+    print_dec(journal_stats.revoked);
+    print(" revoked blocks skipped)\n");
+}
@@ -0,0 +1,66 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include "types.h"
+#include "blockdev.h"
+#include "bcache.h"
+
+#define JOURNAL_MAGIC       0x4C4E524A  /* "JRNL" */
+#define JOURNAL_TXN_BLOCKS  64          /* bloques por transacción */
+#define JOURNAL_OP_BLOCKS   48          /* lo más que toca una operación (fs: FS_OP_BLOCKS) */
+#define JOURNAL_REVOKES     29          /* tramos revocados por transacción */
+#define JOURNAL_OP_REVOKES  8           /* lo más que libera una operación */
+
+/*
+ * Diario de metadatos en una zona reservada del disco. El primer sector
+ * es la cabecera; detrás van las transacciones confirmadas, cada una con
+ * un sector descriptor seguido de las copias de sus bloques, escritas en
+ * un solo comando. El crc32c cubre descriptor y bloques: una transacción
+ * a medio escribir no se reproduce.
+ *
+ * Los tramos liberados se revocan: al reproducir no se escribe ninguna
+ * copia de una transacción anterior a la que los revoca, porque el
+ * sector puede haber pasado a ser datos de un archivo.
+ */
+struct journal_header {
+    u32 magic;
+    u32 seq;                            /* primera transacción válida */
+} __attribute__((packed));
+
+struct journal_revoke {
+    u32 start;
+    u32 count;
+} __attribute__((packed));
+
+struct journal_desc {
+    u32 magic;
+    u32 seq;
+    u32 count;                          /* bloques que siguen */
+    u32 crc;                            /* con este campo a 0 */
+    u32 lba[JOURNAL_TXN_BLOCKS];        /* destino de cada bloque */
+    u32 nrevoke;                        /* 0 en diarios anteriores */
+    struct journal_revoke revoke[JOURNAL_REVOKES];
+} __attribute__((packed));
+
+/* Contadores del diario */
+struct journal_stats {
+    u32 commits;
+    u32 blocks;                         /* bloques escritos en el diario */
+    u32 checkpoints;
+    u32 replayed;                       /* transacciones reproducidas al montar */
+    u32 revoked;                        /* copias no reproducidas por revocadas */
+};
+
+extern struct journal_stats journal_stats;
+
+/* Funciones */
+int journal_format(struct blockdev *dev, u32 start, u32 sectors);
+int journal_replay(struct blockdev *dev, u32 start, u32 sectors);
+void journal_begin(void);
+void journal_dirty(struct bcache_buf *b);
+void journal_revoke(u32 start, u32 count);
+int journal_commit(void);
+int journal_checkpoint(void);
+void journal_print_stats(void);
+
+#endif
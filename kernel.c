@@ -11,6 +11,11 @@
 #include "fs.h"
 #include "shell.h"
 #include "lib.h"
+#include "cpu.h"
+#include "pci.h"
+#include "ahci.h"
+#include "virtio_blk.h"
+#include "bcache.h"
 #include "elf_data.h"
 
 void init_pic(void);
@@ -51,6 +56,9 @@ void kmain(struct mb_partial_info *mbi)
         print("k (upper)\n");
     }
     
+    /* Detectar la CPU y elegir las rutinas de memoria */
+    cpu_init();
+    
     /* Inicializar IDT */
     init_idt();
     print("kernel : idt loaded\n");
@@ -86,10 +94,26 @@ int main(void)
     init_task();
     print("kernel : task initialized\n");    
     
+    /* Enumerar el bus PCI */
+    pci_init();
+    print("kernel : PCI bus enumerated\n");
+    
     /* Inicializar controlador IDE */
     ide_init();
     print("kernel : IDE controller initialized\n");
     
+    /* Inicializar controladores SATA (AHCI) */
+    ahci_init();
+    print("kernel : AHCI controllers initialized\n");
+    
+    /* Inicializar discos paravirtuales (virtio-blk) */
+    virtio_blk_init();
+    print("kernel : virtio-blk devices initialized\n");
+    
+    /* Caché de bloques para el sistema de archivos */
+    bcache_init();
+    print("kernel : Buffer cache initialized\n");
+    
     /* Inicializar sistema de archivos */
     fs_init();
     print("kernel : File system initialized\n");
@@ -143,6 +167,9 @@ int main(void)
     
     print("kernel : ELF programs loaded successfully\n");
     
+    /* Escribir a disco lo que quedó en la caché durante el arranque */
+    fs_sync();
+    
     kattr = 0x47;  /* texto blanco sobre fondo rojo */
     print("kernel : allowing interrupt\n");
     kattr = 0x07;  /* restaurar atributos normales */
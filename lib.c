@@ -1,9 +1,44 @@
 #include "lib.h"
+#include "cpu.h"
 
 /*
  * memcpy: copia 'count' bytes de 'src' a 'dest'
+ * Usa la implementación elegida por cpu_init()
  */
 void *memcpy(void *dest, const void *src, u32 count)
+{
+    return cpu_dispatch.memcpy(dest, src, count);
+}
+
+/*
+ * memset: llena 'count' bytes de 'dest' con 'val'
+ */
+void *memset(void *dest, u8 val, u32 count)
+{
+    return cpu_dispatch.memset(dest, val, count);
+}
+
+/*
+ * strlen: calcula la longitud de una cadena
+ */
+u32 strlen(const char *s)
+{
+    return cpu_dispatch.strlen(s);
+}
+
+/*
+ * crc32c: CRC-32C (Castagnoli) de 'len' bytes, encadenable
+ * (crc32c(0, ...) da el valor estándar)
+ */
+u32 crc32c(u32 crc, const void *buf, u32 len)
+{
+    return cpu_dispatch.crc32c(crc, buf, len);
+}
+
+/*
+ * memcpy_generic: copia byte a byte, válida en cualquier CPU
+ */
+void *memcpy_generic(void *dest, const void *src, u32 count)
 {
     char *d = (char*)dest;
     const char *s = (const char*)src;
@@ -15,9 +50,110 @@ void *memcpy(void *dest, const void *src, u32 count)
 }
 
 /*
- * memset: llena 'count' bytes de 'dest' con 'val'
+ * memcpy_rep: copia por palabras de 32 bits con rep movsl (i386+)
  */
-void *memset(void *dest, u8 val, u32 count)
+void *memcpy_rep(void *dest, const void *src, u32 count)
+{
+    int d0, d1, d2;
+    
+    asm volatile(
+        "cld\n\t"
+        "rep movsl\n\t"
+        "movl %4, %%ecx\n\t"
+        "rep movsb"
+        : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+        : "0" (count >> 2), "g" (count & 3), "1" (dest), "2" (src)
+        : "memory", "cc"
+    );
+    
+    return dest;
+}
+
+/*
+ * memcpy_erms: rep movsb, rápido en CPUs con ERMS
+ */
+void *memcpy_erms(void *dest, const void *src, u32 count)
+{
+    int d0, d1, d2;
+    
+    asm volatile(
+        "cld\n\t"
+        "rep movsb"
+        : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+        : "0" (count), "1" (dest), "2" (src)
+        : "memory", "cc"
+    );
+    
+    return dest;
+}
+
+/*
+ * memcpy_sse2: copia bloques de 64 bytes con registros XMM.
+ * El compilador no usa SSE en el kernel, pero CR4.OSFXSR deja que las
+ * tareas de usuario sí lo usen y el cambio de tarea no guarda su estado
+ * FPU: cada trozo guarda los registros con fxsave y los restaura con
+ * fxrstor al terminar. Se desactivan las interrupciones para que un
+ * manejador no los pise a mitad de copia. Entre trozos no queda nada
+ * vivo en los XMM, así que se corta la copia en trozos de
+ * MEMCPY_SSE2_CHUNK y se dejan pasar las IRQ entre uno y otro: la
+ * latencia queda acotada.
+ */
+#define MEMCPY_SSE2_CHUNK 4096
+
+// Área de fxsave (512 bytes alineados a 16); solo se usa con IF=0
+static u8 memcpy_sse2_fpu[512] __attribute__((aligned(16)));
+
+__attribute__((target("sse2")))
+void *memcpy_sse2(void *dest, const void *src, u32 count)
+{
+    u8 *d = (u8 *)dest;
+    const u8 *s = (const u8 *)src;
+    u32 head, flags, chunk;
+    
+    if (count < 256)
+        return memcpy_rep(dest, src, count);
+    
+    // Alinear el destino a 16 bytes
+    head = (16 - ((u32)d & 15)) & 15;
+    memcpy_rep(d, s, head);
+    d += head;
+    s += head;
+    count -= head;
+    
+    while (count >= 64) {
+        chunk = (count < MEMCPY_SSE2_CHUNK) ? count & ~63 : MEMCPY_SSE2_CHUNK;
+        count -= chunk;
+        
+        asm volatile("pushfl; popl %0; cli" : "=r" (flags) :: "memory");
+        asm volatile("fxsave %0" : "=m" (memcpy_sse2_fpu));
+        for (; chunk; chunk -= 64) {
+            asm volatile(
+                "movdqu (%0), %%xmm0\n\t"
+                "movdqu 16(%0), %%xmm1\n\t"
+                "movdqu 32(%0), %%xmm2\n\t"
+                "movdqu 48(%0), %%xmm3\n\t"
+                "movdqa %%xmm0, (%1)\n\t"
+                "movdqa %%xmm1, 16(%1)\n\t"
+                "movdqa %%xmm2, 32(%1)\n\t"
+                "movdqa %%xmm3, 48(%1)"
+                :: "r" (s), "r" (d)
+                : "memory", "xmm0", "xmm1", "xmm2", "xmm3"
+            );
+            s += 64;
+            d += 64;
+        }
+        asm volatile("fxrstor %0" :: "m" (memcpy_sse2_fpu));
+        asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+    }
+    
+    memcpy_rep(d, s, count);
+    return dest;
+}
+
+/*
+ * memset_generic: llena byte a byte
+ */
+void *memset_generic(void *dest, u8 val, u32 count)
 {
     char *d = (char*)dest;
     
@@ -28,9 +164,48 @@ void *memset(void *dest, u8 val, u32 count)
 }
 
 /*
- * strlen: calcula la longitud de una cadena
+ * memset_rep: llena por palabras de 32 bits con rep stosl (i386+)
  */
-u32 strlen(const char *s)
+void *memset_rep(void *dest, u8 val, u32 count)
+{
+    int d0, d1;
+    u32 pattern = val * 0x01010101;
+    
+    asm volatile(
+        "cld\n\t"
+        "rep stosl\n\t"
+        "movl %4, %%ecx\n\t"
+        "rep stosb"
+        : "=&c" (d0), "=&D" (d1)
+        : "0" (count >> 2), "a" (pattern), "g" (count & 3), "1" (dest)
+        : "memory", "cc"
+    );
+    
+    return dest;
+}
+
+/*
+ * memset_erms: rep stosb, rápido en CPUs con ERMS
+ */
+void *memset_erms(void *dest, u8 val, u32 count)
+{
+    int d0, d1;
+    
+    asm volatile(
+        "cld\n\t"
+        "rep stosb"
+        : "=&c" (d0), "=&D" (d1)
+        : "0" (count), "a" (val), "1" (dest)
+        : "memory", "cc"
+    );
+    
+    return dest;
+}
+
+/*
+ * strlen_generic: cuenta byte a byte
+ */
+u32 strlen_generic(const char *s)
 {
     u32 len = 0;
     
@@ -40,6 +215,85 @@ u32 strlen(const char *s)
     return len;
 }
 
+/*
+ * strlen_word: busca el terminador de 4 en 4 bytes una vez alineado.
+ * Las lecturas alineadas nunca cruzan una página.
+ */
+u32 strlen_word(const char *s)
+{
+    const char *p = s;
+    const u32 *w;
+    
+    while ((u32)p & 3) {
+        if (*p == '\0')
+            return p - s;
+        p++;
+    }
+    
+    w = (const u32 *)p;
+    while (!((*w - 0x01010101) & ~*w & 0x80808080))
+        w++;
+    
+    p = (const char *)w;
+    while (*p)
+        p++;
+    
+    return p - s;
+}
+
+/* Tabla para el CRC-32C por software (polinomio reflejado 0x82F63B78) */
+static u32 crc32c_table[256];
+
+static void crc32c_init_table(void)
+{
+    u32 i, j, c;
+    
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+        crc32c_table[i] = c;
+    }
+}
+
+/*
+ * crc32c_generic: CRC-32C por tabla, un byte por iteración
+ */
+u32 crc32c_generic(u32 crc, const void *buf, u32 len)
+{
+    const u8 *p = (const u8 *)buf;
+    
+    if (crc32c_table[1] == 0)
+        crc32c_init_table();
+    
+    crc = ~crc;
+    while (len--)
+        crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    
+    return ~crc;
+}
+
+/*
+ * crc32c_sse42: CRC-32C con la instrucción crc32 de SSE4.2
+ */
+u32 crc32c_sse42(u32 crc, const void *buf, u32 len)
+{
+    const u8 *p = (const u8 *)buf;
+    
+    crc = ~crc;
+    while (len >= 4) {
+        asm("crc32l %1, %0" : "+r" (crc) : "rm" (*(const u32 *)p));
+        p += 4;
+        len -= 4;
+    }
+    while (len--) {
+        asm("crc32b %1, %0" : "+r" (crc) : "rm" (*p));
+        p++;
+    }
+    
+    return ~crc;
+}
+
 /*
  * strcmp: compara dos cadenas
  */
@@ -10,5 +10,19 @@ void insl(int port, void *addr, int cnt);
 void outsl(int port, const void *addr, int cnt);
 u32 strlen(const char *s);
 int strcmp(const char *s1, const char *s2);
+u32 crc32c(u32 crc, const void *buf, u32 len);
+
+/* Implementaciones alternativas, enlazadas por cpu_init() */
+void *memcpy_generic(void *dest, const void *src, u32 count);
+void *memcpy_rep(void *dest, const void *src, u32 count);
+void *memcpy_erms(void *dest, const void *src, u32 count);
+void *memcpy_sse2(void *dest, const void *src, u32 count);
+void *memset_generic(void *dest, u8 val, u32 count);
+void *memset_rep(void *dest, u8 val, u32 count);
+void *memset_erms(void *dest, u8 val, u32 count);
+u32 strlen_generic(const char *s);
+u32 strlen_word(const char *s);
+u32 crc32c_generic(u32 crc, const void *buf, u32 len);
+u32 crc32c_sse42(u32 crc, const void *buf, u32 len);
 
 #endif
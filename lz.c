@@ -0,0 +1,157 @@
+#include "lz.h"
+#include "lib.h"
+
+/* Última posición vista de cada hash de 4 bytes */
+static u16 lz_table[1 << LZ_HASH_BITS];
+
+static u32 lz_read32(const u8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static u32 lz_hash(u32 v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Longitud extendida: bytes de 255 y un resto (parte de 15 en el token) */
+static u8 *lz_put_len(u8 *op, u32 len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (u8)len;
+    return op;
+}
+
+/*
+ * Comprimir 'len' bytes (hasta LZ_MAX_INPUT) en dst. Devuelve el tamaño
+ * comprimido, o 0 si no cabe en 'cap' bytes: el llamador guarda entonces
+ * los datos tal cual.
+ */
+u32 lz_compress(const u8 *src, u32 len, u8 *dst, u32 cap)
+{
+    const u8 *ip = src;
+    const u8 *anchor = src;                 /* inicio de los literales pendientes */
+    const u8 *end = src + len;
+    const u8 *mflimit = (len > LZ_MF_LIMIT) ? end - LZ_MF_LIMIT : src;
+    u8 *op = dst;
+    u8 *oend = dst + cap;
+
+    if (len > LZ_MAX_INPUT)
+        return 0;
+    memset(lz_table, 0, sizeof(lz_table));
+
+    while (ip < mflimit) {
+        u32 h = lz_hash(lz_read32(ip));
+        const u8 *ref = src + lz_table[h];
+
+        lz_table[h] = (u16)(ip - src);
+        if (ref >= ip || lz_read32(ref) != lz_read32(ip)) {
+            ip++;
+            continue;
+        }
+
+        // Alargar la coincidencia sin entrar en los últimos literales
+        u32 mlen = LZ_MIN_MATCH;
+        while (ip + mlen < end - LZ_LAST_LITERALS && ref[mlen] == ip[mlen])
+            mlen++;
+
+        u32 lits = ip - anchor;
+        if (op + 1 + lits / 255 + 1 + lits + 2 + (mlen - LZ_MIN_MATCH) / 255 + 1 > oend)
+            return 0;
+
+        u8 *token = op++;
+        *token = (u8)(((lits < 15) ? lits : 15) << 4);
+        if (lits >= 15)
+            op = lz_put_len(op, lits - 15);
+        memcpy(op, anchor, lits);
+        op += lits;
+
+        u32 off = ip - ref;
+        *op++ = (u8)off;
+        *op++ = (u8)(off >> 8);
+
+        u32 ml = mlen - LZ_MIN_MATCH;
+        *token |= (ml < 15) ? ml : 15;
+        if (ml >= 15)
+            op = lz_put_len(op, ml - 15);
+
+        ip += mlen;
+        anchor = ip;
+    }
+
+    // Última secuencia: el resto como literales
+    u32 lits = end - anchor;
+    if (op + 1 + lits / 255 + 1 + lits > oend)
+        return 0;
+    *op++ = (u8)(((lits < 15) ? lits : 15) << 4);
+    if (lits >= 15)
+        op = lz_put_len(op, lits - 15);
+    memcpy(op, anchor, lits);
+    op += lits;
+
+    return op - dst;
+}
+
+/* Leer una longitud extendida; -1 si se sale de la entrada */
+static int lz_get_len(const u8 **ip, const u8 *end, u32 *len)
+{
+    u8 b;
+
+    do {
+        if (*ip >= end)
+            return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/*
+ * Descomprimir un bloque de 'len' bytes en dst (hasta 'cap' bytes).
+ * Devuelve los bytes producidos o -1 si el bloque está corrupto.
+ */
+int lz_decompress(const u8 *src, u32 len, u8 *dst, u32 cap)
+{
+    const u8 *ip = src;
+    const u8 *end = src + len;
+    u8 *op = dst;
+    u8 *oend = dst + cap;
+
+    while (ip < end) {
+        u8 token = *ip++;
+        u32 lits = token >> 4;
+
+        if (lits == 15 && lz_get_len(&ip, end, &lits) != 0)
+            return -1;
+        if (lits > (u32)(end - ip) || lits > (u32)(oend - op))
+            return -1;
+        memcpy(op, ip, lits);
+        ip += lits;
+        op += lits;
+        if (ip == end)
+            break;                          /* última secuencia */
+
+        if (end - ip < 2)
+            return -1;
+        u32 off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (off == 0 || off > (u32)(op - dst))
+            return -1;
+
+        u32 mlen = token & 15;
+        if (mlen == 15 && lz_get_len(&ip, end, &mlen) != 0)
+            return -1;
+        mlen += LZ_MIN_MATCH;
+        if (mlen > (u32)(oend - op))
+            return -1;
+
+        // Byte a byte: la copia puede solaparse consigo misma
+        const u8 *ref = op - off;
+        while (mlen--)
+            *op++ = *ref++;
+    }
+    return op - dst;
+}
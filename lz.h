@@ -0,0 +1,21 @@
+#ifndef LZ_H_
+#define LZ_H_
+
+#include "types.h"
+
+/*
+ * Compresión LZ77 con el formato de bloque de LZ4: secuencias de un
+ * token (literales:4 | coincidencia:4), literales y desplazamiento de 16
+ * bits. La última secuencia solo lleva literales.
+ */
+#define LZ_MIN_MATCH        4
+#define LZ_HASH_BITS        12          /* tabla de posiciones: 8KB */
+#define LZ_LAST_LITERALS    5           /* los últimos bytes van siempre literales */
+#define LZ_MF_LIMIT         12          /* no empezar coincidencias tan cerca del final */
+#define LZ_MAX_INPUT        65535       /* desplazamientos y posiciones de 16 bits */
+
+/* Funciones */
+u32 lz_compress(const u8 *src, u32 len, u8 *dst, u32 cap);
+int lz_decompress(const u8 *src, u32 len, u8 *dst, u32 cap);
+
+#endif
@@ -95,6 +95,40 @@ void init_mm(void)
     print("mm     : paging enabled successfully\n");
 }
 
+/*
+ * Mapea registros de un dispositivo (BAR de memoria PCI) con identidad
+ * en el directorio del kernel, sin caché. Las tablas de páginas nuevas
+ * salen de get_page_frame(), que entrega páginas bajas ya mapeadas.
+ */
+void *mm_map_mmio(u32 phys_addr, u32 size)
+{
+    u32 addr, end;
+    u32 *pt;
+    int i;
+
+    addr = phys_addr & PAGE_MASK;
+    end = phys_addr + size;
+
+    for (; addr < end && addr >= (phys_addr & PAGE_MASK); addr += PAGE_SIZE) {
+        if (!(pd0[VADDR_PD_OFFSET(addr)] & PAGE_PRESENT)) {
+            pt = (u32 *)get_page_frame();
+            if (pt == (u32 *)-1) {
+                print("mm     : ERROR: Cannot allocate MMIO page table\n");
+                return NULL;
+            }
+            for (i = 0; i < 1024; i++)
+                pt[i] = 0;
+            pd0[VADDR_PD_OFFSET(addr)] = (u32)pt | PAGE_PRESENT | PAGE_RW;
+        }
+
+        pt = (u32 *)(pd0[VADDR_PD_OFFSET(addr)] & PAGE_MASK);
+        pt[VADDR_PT_OFFSET(addr)] = addr | PAGE_PRESENT | PAGE_RW | PAGE_PCD | PAGE_PWT;
+        asm volatile("invlpg (%0)" :: "r" (addr) : "memory");
+    }
+
+    return (void *)phys_addr;
+}
+
 /*
  * Crea un directorio de páginas para una tarea de usuario
  */
@@ -14,6 +14,8 @@
 #define PAGE_PRESENT    0x01            /* Página presente en memoria */
 #define PAGE_RW         0x02            /* Página de lectura/escritura */
 #define PAGE_USER       0x04            /* Página accesible desde modo usuario */
+#define PAGE_PWT        0x08            /* Write-through */
+#define PAGE_PCD        0x10            /* Caché deshabilitada (registros MMIO) */
 #define PAGE_ACCESSED   0x20            /* Página accedida */
 #define PAGE_DIRTY      0x40            /* Página modificada */
 
@@ -21,6 +23,7 @@
 #define RAM_MAXPAGE     0x20000         /* Número máximo de páginas físicas (512MB / 4KB) */
 #define USER_OFFSET     0x40000000      /* Offset base para espacio de usuario */
 #define USER_STACK      0xE0000000      /* Dirección de pila de usuario */
+#define MMIO_PDE_START  768             /* PDEs >= 3GB: ventanas MMIO del kernel */
 
 /* Macros para manipular direcciones */
 #define PAGE(addr)              ((addr) >> 12)           /* Obtener número de página */
@@ -111,9 +114,11 @@ void page_fault_handler(void);
 char *get_page_frame(void);
 void release_page_frame(u32 p_addr);
 u32 *pd_create_task1(void);
+void *mm_map_mmio(u32 phys_addr, u32 size);
 void *kmalloc(u32 size);
 void *kmalloc_debug(u32 size, const char *file, int line);
 void kfree(void *ptr);
+void *kmalloc_aligned(u32 size, u32 align);
 void *get_page_from_heap(void);
 void release_page_from_heap(void *ptr);
 void init_heap(void);
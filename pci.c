@@ -0,0 +1,323 @@
+#include "pci.h"
+#include "io.h"
+#include "lib.h"
+#include "screen.h"
+
+/* Tabla de dispositivos encontrados */
+struct pci_device pci_devices[PCI_MAX_DEVICES];
+int pci_device_count = 0;
+
+/* Nombres de las clases más comunes (para lspci) */
+static const char *pci_class_name(u8 class_code, u8 subclass)
+{
+    switch (class_code) {
+    case 0x01:
+        switch (subclass) {
+        case 0x01: return "IDE controller";
+        case 0x06: return "SATA controller";
+        case 0x00: return "SCSI controller";
+        default:   return "Storage controller";
+        }
+    case 0x02: return "Network controller";
+    case 0x03: return "VGA controller";
+    case 0x04: return "Multimedia controller";
+    case 0x06:
+        switch (subclass) {
+        case 0x00: return "Host bridge";
+        case 0x01: return "ISA bridge";
+        case 0x04: return "PCI bridge";
+        case 0x80: return "Bridge";
+        default:   return "Bridge device";
+        }
+    case 0x0C:
+        if (subclass == 0x03) return "USB controller";
+        if (subclass == 0x05) return "SMBus controller";
+        return "Serial bus controller";
+    default:   return "Unknown device";
+    }
+}
+
+static u32 pci_config_address(u8 bus, u8 slot, u8 func, u8 offset)
+{
+    return 0x80000000 | ((u32)bus << 16) | ((u32)(slot & 0x1F) << 11) |
+           ((u32)(func & 0x07) << 8) | (offset & 0xFC);
+}
+
+/* Lectura/escritura del espacio de configuración (mecanismo #1) */
+u32 pci_config_read32(u8 bus, u8 slot, u8 func, u8 offset)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(bus, slot, func, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+u16 pci_config_read16(u8 bus, u8 slot, u8 func, u8 offset)
+{
+    u32 value = pci_config_read32(bus, slot, func, offset);
+    return (value >> ((offset & 2) * 8)) & 0xFFFF;
+}
+
+u8 pci_config_read8(u8 bus, u8 slot, u8 func, u8 offset)
+{
+    u32 value = pci_config_read32(bus, slot, func, offset);
+    return (value >> ((offset & 3) * 8)) & 0xFF;
+}
+
+void pci_config_write32(u8 bus, u8 slot, u8 func, u8 offset, u32 value)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(bus, slot, func, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+/*
+ * Escritura de 16 bits directa en su mitad del dword: un leer-modificar-
+ * escribir devolvería el registro vecino (p.ej. STATUS junto a COMMAND)
+ * y borraría sus bits de error, que se limpian escribiendo un 1.
+ */
+void pci_config_write16(u8 bus, u8 slot, u8 func, u8 offset, u16 value)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(bus, slot, func, offset));
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+/*
+ * Lee un BAR y calcula su tamaño escribiendo todos unos y restaurando
+ * el valor original. Los BAR de 64 bits ocupan dos entradas.
+ */
+static int pci_probe_bar(struct pci_device *dev, int i)
+{
+    u8 offset = PCI_BAR0 + i * 4;
+    u32 orig = pci_config_read32(dev->bus, dev->slot, dev->func, offset);
+    u32 mask;
+
+    pci_config_write32(dev->bus, dev->slot, dev->func, offset, 0xFFFFFFFF);
+    mask = pci_config_read32(dev->bus, dev->slot, dev->func, offset);
+    pci_config_write32(dev->bus, dev->slot, dev->func, offset, orig);
+
+    if (orig & PCI_BAR_IO) {
+        dev->bar_is_io[i] = 1;
+        dev->bar[i] = orig & PCI_BAR_IO_MASK;
+        mask &= PCI_BAR_IO_MASK & 0xFFFF;
+    } else {
+        dev->bar_is_io[i] = 0;
+        dev->bar[i] = orig & PCI_BAR_MEM_MASK;
+        mask &= PCI_BAR_MEM_MASK;
+    }
+
+    dev->bar_size[i] = mask ? (~mask + 1) & (dev->bar_is_io[i] ? 0xFFFF : 0xFFFFFFFF) : 0;
+
+    /* BAR de memoria de 64 bits: la parte alta ocupa el siguiente */
+    if (!dev->bar_is_io[i] && ((orig >> 1) & 0x3) == 0x2) {
+        return 2;
+    }
+    return 1;
+}
+
+static void pci_add_device(u8 bus, u8 slot, u8 func)
+{
+    struct pci_device *dev;
+    u8 header;
+    u16 cmd;
+    int i;
+
+    if (pci_device_count >= PCI_MAX_DEVICES) {
+        print("pci    : device table full\n");
+        return;
+    }
+
+    dev = &pci_devices[pci_device_count];
+    memset(dev, 0, sizeof(struct pci_device));
+
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->func = func;
+    dev->vendor = pci_config_read16(bus, slot, func, PCI_VENDOR_ID);
+    dev->device = pci_config_read16(bus, slot, func, PCI_DEVICE_ID);
+    dev->class_code = pci_config_read8(bus, slot, func, PCI_CLASS);
+    dev->subclass = pci_config_read8(bus, slot, func, PCI_SUBCLASS);
+    dev->prog_if = pci_config_read8(bus, slot, func, PCI_PROG_IF);
+    dev->revision = pci_config_read8(bus, slot, func, PCI_REVISION);
+    dev->irq_line = pci_config_read8(bus, slot, func, PCI_INTERRUPT_LINE);
+    dev->irq_pin = pci_config_read8(bus, slot, func, PCI_INTERRUPT_PIN);
+
+    /* Solo las cabeceras tipo 0 tienen 6 BAR. Se apaga la decodificación
+       mientras se miden para no mover ventanas en uso. */
+    header = pci_config_read8(bus, slot, func, PCI_HEADER_TYPE) & 0x7F;
+    if (header == 0) {
+        cmd = pci_config_read16(bus, slot, func, PCI_COMMAND);
+        pci_config_write16(bus, slot, func, PCI_COMMAND,
+                           cmd & ~(PCI_CMD_IO | PCI_CMD_MEMORY));
+        for (i = 0; i < PCI_NUM_BARS; ) {
+            i += pci_probe_bar(dev, i);
+        }
+        pci_config_write16(bus, slot, func, PCI_COMMAND, cmd);
+    }
+
+    pci_device_count++;
+}
+
+/* Recorre todos los buses, slots y funciones */
+static void pci_scan(void)
+{
+    u32 bus;
+    u8 slot, func, nfuncs;
+
+    for (bus = 0; bus < 256; bus++) {
+        for (slot = 0; slot < 32; slot++) {
+            if (pci_config_read16(bus, slot, 0, PCI_VENDOR_ID) == 0xFFFF)
+                continue;
+
+            /* Bit 7 de la cabecera: dispositivo multifunción */
+            nfuncs = (pci_config_read8(bus, slot, 0, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+
+            for (func = 0; func < nfuncs; func++) {
+                if (pci_config_read16(bus, slot, func, PCI_VENDOR_ID) != 0xFFFF)
+                    pci_add_device(bus, slot, func);
+            }
+        }
+    }
+}
+
+/* Inicializa el subsistema PCI enumerando los dispositivos */
+void pci_init(void)
+{
+    pci_device_count = 0;
+
+    /* Comprobar que existe el mecanismo de configuración #1 */
+    outl(PCI_CONFIG_ADDRESS, 0x80000000);
+    if (inl(PCI_CONFIG_ADDRESS) != 0x80000000) {
+        print("pci    : no PCI configuration mechanism found\n");
+        return;
+    }
+
+    pci_scan();
+
+    print("pci    : ");
+    print_dec(pci_device_count);
+    print(" devices found\n");
+}
+
+/* Habilita la decodificación de I/O y memoria del dispositivo */
+void pci_enable_device(struct pci_device *dev)
+{
+    u16 cmd = pci_config_read16(dev->bus, dev->slot, dev->func, PCI_COMMAND);
+
+    cmd |= PCI_CMD_IO | PCI_CMD_MEMORY;
+    pci_config_write16(dev->bus, dev->slot, dev->func, PCI_COMMAND, cmd);
+}
+
+/* Permite que el dispositivo haga DMA como bus master */
+void pci_enable_bus_master(struct pci_device *dev)
+{
+    u16 cmd = pci_config_read16(dev->bus, dev->slot, dev->func, PCI_COMMAND);
+
+    cmd |= PCI_CMD_BUS_MASTER;
+    pci_config_write16(dev->bus, dev->slot, dev->func, PCI_COMMAND, cmd);
+}
+
+static int pci_driver_matches(struct pci_driver *drv, struct pci_device *dev)
+{
+    if (drv->vendor != PCI_ANY_ID && drv->vendor != dev->vendor)
+        return 0;
+    if (drv->device != PCI_ANY_ID && drv->device != dev->device)
+        return 0;
+    if (drv->class_code != PCI_ANY_CLASS &&
+        (drv->class_code != dev->class_code || drv->subclass != dev->subclass))
+        return 0;
+    return 1;
+}
+
+/*
+ * Registra un driver y lo enlaza con los dispositivos libres que
+ * coincidan. Devuelve el número de dispositivos tomados.
+ */
+int pci_register_driver(struct pci_driver *drv)
+{
+    int i, bound = 0;
+
+    for (i = 0; i < pci_device_count; i++) {
+        struct pci_device *dev = &pci_devices[i];
+
+        if (dev->driver || !pci_driver_matches(drv, dev))
+            continue;
+
+        if (drv->probe(dev) == 0) {
+            dev->driver = drv;
+            bound++;
+        }
+    }
+
+    return bound;
+}
+
+/* Busca el primer dispositivo de una clase/subclase */
+struct pci_device *pci_find_class(u8 class_code, u8 subclass)
+{
+    int i;
+
+    for (i = 0; i < pci_device_count; i++) {
+        if (pci_devices[i].class_code == class_code &&
+            pci_devices[i].subclass == subclass)
+            return &pci_devices[i];
+    }
+    return NULL;
+}
+
+static void print_hex_digits(u32 n, int digits)
+{
+    char hex_chars[] = "0123456789abcdef";
+    int i;
+
+    for (i = (digits - 1) * 4; i >= 0; i -= 4) {
+        putcar(hex_chars[(n >> i) & 0xF]);
+    }
+}
+
+/* Lista los dispositivos (comando 'lspci') */
+void pci_list_devices(void)
+{
+    int i, b;
+
+    if (pci_device_count == 0) {
+        print("No PCI devices found\n");
+        return;
+    }
+
+    for (i = 0; i < pci_device_count; i++) {
+        struct pci_device *dev = &pci_devices[i];
+
+        print_hex_digits(dev->bus, 2);
+        putcar(':');
+        print_hex_digits(dev->slot, 2);
+        putcar('.');
+        print_hex_digits(dev->func, 1);
+        putcar(' ');
+        print_hex_digits(dev->vendor, 4);
+        putcar(':');
+        print_hex_digits(dev->device, 4);
+        putcar(' ');
+        print((char *)pci_class_name(dev->class_code, dev->subclass));
+
+        if (dev->irq_pin) {
+            print(" irq ");
+            print_dec(dev->irq_line);
+        }
+        if (dev->driver) {
+            print(" [");
+            print((char *)dev->driver->name);
+            print("]");
+        }
+        print("\n");
+
+        for (b = 0; b < PCI_NUM_BARS; b++) {
+            if (dev->bar_size[b] == 0)
+                continue;
+            print("        BAR");
+            print_dec(b);
+            print(dev->bar_is_io[b] ? ": io  " : ": mem ");
+            print_hex(dev->bar[b]);
+            print(" size ");
+            print_dec(dev->bar_size[b]);
+            print("\n");
+        }
+    }
+}
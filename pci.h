@@ -0,0 +1,92 @@
+#ifndef PCI_H_
+#define PCI_H_
+
+#include "types.h"
+
+/* Puertos del mecanismo de configuración #1 */
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+/* Registros del espacio de configuración (cabecera tipo 0) */
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION        0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_INTERRUPT_LINE  0x3C
+#define PCI_INTERRUPT_PIN   0x3D
+
+/* Bits del registro de comando */
+#define PCI_CMD_IO          0x0001
+#define PCI_CMD_MEMORY      0x0002
+#define PCI_CMD_BUS_MASTER  0x0004
+
+/* Bits de los BAR */
+#define PCI_BAR_IO          0x01
+#define PCI_BAR_IO_MASK     0xFFFFFFFC
+#define PCI_BAR_MEM_MASK    0xFFFFFFF0
+
+#define PCI_MAX_DEVICES     32
+#define PCI_NUM_BARS        6
+#define PCI_ANY_ID          0xFFFF
+#define PCI_ANY_CLASS       0xFF
+
+struct pci_driver;
+
+/* Dispositivo encontrado durante la enumeración */
+struct pci_device {
+    u8 bus;
+    u8 slot;
+    u8 func;
+    u16 vendor;
+    u16 device;
+    u8 class_code;
+    u8 subclass;
+    u8 prog_if;
+    u8 revision;
+    u8 irq_line;
+    u8 irq_pin;
+    u32 bar[PCI_NUM_BARS];          /* dirección base (sin bits de tipo) */
+    u32 bar_size[PCI_NUM_BARS];
+    u8 bar_is_io[PCI_NUM_BARS];
+    struct pci_driver *driver;
+    void *driver_data;
+};
+
+/*
+ * Driver PCI: se enlaza con los dispositivos cuyo vendor/device coinciden
+ * (PCI_ANY_ID acepta cualquiera) y, si class_code no es PCI_ANY_CLASS,
+ * con la clase/subclase indicadas. probe() devuelve 0 si toma el dispositivo.
+ */
+struct pci_driver {
+    const char *name;
+    u16 vendor;
+    u16 device;
+    u8 class_code;
+    u8 subclass;
+    int (*probe)(struct pci_device *dev);
+};
+
+/* Variables globales */
+extern struct pci_device pci_devices[PCI_MAX_DEVICES];
+extern int pci_device_count;
+
+/* Funciones */
+void pci_init(void);
+u32 pci_config_read32(u8 bus, u8 slot, u8 func, u8 offset);
+u16 pci_config_read16(u8 bus, u8 slot, u8 func, u8 offset);
+u8 pci_config_read8(u8 bus, u8 slot, u8 func, u8 offset);
+void pci_config_write32(u8 bus, u8 slot, u8 func, u8 offset, u32 value);
+void pci_config_write16(u8 bus, u8 slot, u8 func, u8 offset, u16 value);
+void pci_enable_device(struct pci_device *dev);
+void pci_enable_bus_master(struct pci_device *dev);
+int pci_register_driver(struct pci_driver *drv);
+struct pci_device *pci_find_class(u8 class_code, u8 subclass);
+void pci_list_devices(void);
+
+#endif
@@ -129,6 +129,10 @@ u32 *pd_create(u32 *code_phys_addr, unsigned int code_size)
     /* Espacio kernel - compartido con todas las tareas */
     pd[0] = (u32)pt0 | PAGE_PRESENT | PAGE_RW;
 
+    /* Ventanas MMIO de los drivers: las IRQ pueden llegar con este CR3 */
+    for (i = MMIO_PDE_START; i < 1023; i++)
+        pd[i] = pd0[i];
+
     /* Espacio usuario - mapear 0x40000000 a la dirección física del código */
     pd[USER_OFFSET >> 22] = (u32)pt | PAGE_PRESENT | PAGE_RW | PAGE_USER;
     pt[0] = (u32)code_phys_addr | PAGE_PRESENT | PAGE_RW | PAGE_USER;
@@ -1,6 +1,7 @@
 #include "types.h"
 #include "screen.h"
 #include "io.h"
+#include "kbd.h"
 
 /* Variables globales para la pantalla */
 u8 kX = 0;
@@ -42,14 +43,76 @@ void putcar(uchar c)
     }
 }
 
+/*
+ * Escribir 'len' bytes en la memoria de vídeo. Los tramos de caracteres
+ * normales se copian seguidos hasta un carácter de control o el final de
+ * la línea, sin una llamada a putcar() por carácter.
+ */
+static void screen_write(const char *s, u32 len)
+{
+    u32 i = 0;
+    
+    while (i < len) {
+        uchar c = s[i];
+        
+        if (c == '\n' || c == '\t' || c == '\b') {
+            putcar(c);
+            i++;
+            continue;
+        }
+        
+        u16 *cell = videomem + kY * 80 + kX;
+        u16 attr = kattr << 8;
+        u32 n = 80 - kX;
+        u32 k;
+        
+        if (n > len - i) {
+            n = len - i;
+        }
+        for (k = 0; k < n; k++) {
+            c = s[i + k];
+            if (c == '\n' || c == '\t' || c == '\b') {
+                break;
+            }
+            cell[k] = attr | c;
+        }
+        i += k;
+        kX += k;
+        
+        /* Manejar wrap-around y scroll */
+        if (kX >= 80) {
+            kX = 0;
+            kY++;
+        }
+        if (kY >= 25) {
+            kY = 24;
+            scrollup();
+        }
+    }
+}
+
 /*
  * Función para imprimir una cadena
  */
 void print(char *s)
 {
-    while (*s) {
-        putcar(*s++);
+    u32 len = 0;
+    
+    while (s[len]) {
+        len++;
     }
+    screen_write(s, len);
+}
+
+/*
+ * Imprimir un bloque de longitud conocida (los bytes nulos salen en
+ * blanco) y mover el cursor una sola vez, al final. 'cat' la usa como
+ * destino de fs_stream_read(), una llamada por sector.
+ */
+void print_buf(const char *s, u32 len)
+{
+    screen_write(s, len);
+    show_cursor();
 }
 
 /*
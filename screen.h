@@ -11,6 +11,7 @@ extern u8 kattr;     /* atributo de color actual */
 /* Funciones de pantalla */
 void putcar(uchar c);
 void print(char *s);
+void print_buf(const char *s, u32 len);
 void clear_screen(void);
 void scrollup(void);
 void print_hex(u32 n);
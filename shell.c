@@ -8,6 +8,11 @@
 #include "task.h"
 #include "lib.h"
 #include "io.h"
+#include "cpu.h"
+#include "pci.h"
+#include "blockdev.h"
+#include "bcache.h"
+#include "stripe.h"
 
 /* Variables globales */
 char shell_buffer[SHELL_BUFFER_SIZE];
@@ -16,12 +21,14 @@ int shell_buffer_pos = 0;
 /* Tabla de comandos */
 struct command shell_commands[] = {
     {"help", cmd_help, "Show available commands"},
-    {"ls", cmd_ls, "List files in current directory"},
+    {"ls", cmd_ls, "List a directory [path]"},
     {"cat", cmd_cat, "Display file contents"},
     {"echo", cmd_echo, "Display text"},
     {"clear", cmd_clear, "Clear screen"},
     {"create", cmd_create, "Create a new file"},
-    {"delete", cmd_delete, "Delete a file"},
+    {"delete", cmd_delete, "Delete a file or an empty directory"},
+    {"mkdir", cmd_mkdir, "Create a directory"},
+    {"compress", cmd_compress, "Store a file compressed"},
     {"write", cmd_write, "Write text to a file"},
     {"exec", cmd_exec, "Execute an ELF file"},
     {"ps", cmd_ps, "Show running processes"},
@@ -32,7 +39,14 @@ struct command shell_commands[] = {
     {"leaks", cmd_leaks, "Check for memory leaks"},
     {"defrag", cmd_defrag, "Defragment the heap"},
     {"heapmap", cmd_heapmap, "Show detailed heap map"},
-    {"fsstat", cmd_fsstat, "Show file system statistics"}
+    {"fsstat", cmd_fsstat, "Show file system statistics"},
+    {"cpuinfo", cmd_cpuinfo, "Show CPU features and selected kernels"},
+    {"lspci", cmd_lspci, "List PCI devices"},
+    {"lsblk", cmd_lsblk, "List block devices"},
+    {"blkbench", cmd_blkbench, "Benchmark block device reads"},
+    {"sync", cmd_sync, "Write cached blocks to disk"},
+    {"iostat", cmd_iostat, "Show disk I/O statistics [-r to reset]"},
+    {"stripe", cmd_stripe, "Create a RAID-0 volume [-c KB] <dev> <dev>..."}
 };
 
 int shell_command_count = sizeof(shell_commands) / sizeof(struct command);
@@ -188,7 +202,7 @@ void cmd_help(int argc, char **argv) {
 
 /* Comando: ls */
 void cmd_ls(int argc, char **argv) {
-    fs_list_files();
+    fs_list_files(argc > 1 ? argv[1] : "/");
 }
 
 /* Fixed cat command using traditional approach */
@@ -226,18 +240,17 @@ void cmd_cat(int argc, char **argv) {
     print(":\n");
     print("----------------------------------------\n");
     
-    // Read file in small chunks to minimize memory usage
-    char buffer[256];  // Small buffer on stack
+    // En flujo: cada tramo sale a pantalla desde la caché, sin copiarlo;
+    // el read-ahead de cada trozo va en un solo comando
     int bytes_read;
     
     do {
-        bytes_read = fs_read_file(fd, buffer, sizeof(buffer) - 1);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';  // Null terminate
-            print(buffer);
-        }
+        bytes_read = fs_stream_read(fd, print_buf, CAT_CHUNK);
     } while (bytes_read > 0);
     
+    if (bytes_read < 0) {
+        print("\ncat: read error");
+    }
     print("\n----------------------------------------\n");
     fs_close_file(fd);
 }
@@ -304,6 +317,42 @@ void cmd_delete(int argc, char **argv) {
     }
 }
 
+/* Comando: mkdir */
+void cmd_mkdir(int argc, char **argv) {
+    if (argc < 2) {
+        print("Usage: mkdir <path>\n");
+        return;
+    }
+    
+    if (fs_mkdir(argv[1]) == 0) {
+        print("Directory created: ");
+        print(argv[1]);
+        print("\n");
+    } else {
+        print("Cannot create directory: ");
+        print(argv[1]);
+        print("\n");
+    }
+}
+
+/* Comando: compress */
+void cmd_compress(int argc, char **argv) {
+    if (argc < 2) {
+        print("Usage: compress <filename>\n");
+        return;
+    }
+    
+    if (fs_compress_file(argv[1]) == 0) {
+        print("File compressed: ");
+        print(argv[1]);
+        print("\n");
+    } else {
+        print("Cannot compress file: ");
+        print(argv[1]);
+        print("\n");
+    }
+}
+
 /* Comando: write */
 void cmd_write(int argc, char **argv) {
     if (argc < 3) {
@@ -418,6 +467,132 @@ void cmd_fsstat(int argc, char **argv) {
     fs_print_stats();
 }
 
+/* Comando: sync - Write cached blocks to disk */
+void cmd_sync(int argc, char **argv) {
+    // El fs confirma su diario y escribe todos los bloques sucios
+    int written = fs_sync();
+    
+    if (written < 0) {
+        written = bcache_sync(NULL);
+    }
+    
+    print_dec(written);
+    print(" blocks written\n");
+}
+
+/* Comando: iostat - Show disk I/O statistics */
+void cmd_iostat(int argc, char **argv) {
+    struct blockdev *dev;
+    int reset = (argc > 1 && strcmp(argv[1], "-r") == 0);
+    int i;
+    
+    for (i = 0; (dev = blockdev_get(i)) != NULL; i++) {
+        if (reset) {
+            blockdev_reset_iostat(dev);
+        } else {
+            blockdev_print_iostat(dev);
+        }
+    }
+    if (reset) {
+        print("I/O statistics reset\n");
+    }
+}
+
+/* Comando: stripe - Create a RAID-0 volume over several disks */
+void cmd_stripe(int argc, char **argv) {
+    struct blockdev *members[STRIPE_MAX_MEMBERS];
+    struct blockdev *dev;
+    u32 chunk = 0;
+    int n = 0;
+    int i;
+    
+    if (argc == 1) {
+        stripe_list();
+        return;
+    }
+    
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            // Tamaño de franja en KB
+            char *kb_str = argv[++i];
+            chunk = 0;
+            while (*kb_str >= '0' && *kb_str <= '9') {
+                chunk = chunk * 10 + (*kb_str - '0');
+                kb_str++;
+            }
+            chunk *= 2;
+            if (chunk == 0) {
+                print("stripe: invalid chunk size\n");
+                return;
+            }
+            continue;
+        }
+        
+        if (n >= STRIPE_MAX_MEMBERS) {
+            print("stripe: too many devices\n");
+            return;
+        }
+        dev = blockdev_find(argv[i]);
+        if (dev == NULL) {
+            print("stripe: no such device: ");
+            print(argv[i]);
+            print("\n");
+            return;
+        }
+        members[n++] = dev;
+    }
+    
+    if (n < 2) {
+        print("Usage: stripe [-c KB] <dev> <dev> [<dev> <dev>]\n");
+        return;
+    }
+    
+    dev = stripe_create(members, n, chunk);
+    if (dev) {
+        print("Created ");
+        print(dev->name);
+        print(" (try 'blkbench ");
+        print(dev->name);
+        print("')\n");
+    }
+}
+
+/* Comando: cpuinfo - Show CPU features and selected kernels */
+void cmd_cpuinfo(int argc, char **argv) {
+    cpu_print_info();
+}
+
+/* Comando: lspci - List PCI devices */
+void cmd_lspci(int argc, char **argv) {
+    pci_list_devices();
+}
+
+/* Comando: lsblk - List block devices */
+void cmd_lsblk(int argc, char **argv) {
+    blockdev_list();
+}
+
+/* Comando: blkbench - Benchmark block device reads */
+void cmd_blkbench(int argc, char **argv) {
+    struct blockdev *dev;
+    int i;
+
+    if (argc > 1) {
+        dev = blockdev_find(argv[1]);
+        if (dev == NULL) {
+            print("blkbench: no such device\n");
+            return;
+        }
+        blockdev_bench(dev);
+        return;
+    }
+
+    // Sin argumentos: comparar todos los dispositivos registrados
+    for (i = 0; (dev = blockdev_get(i)) != NULL; i++) {
+        blockdev_bench(dev);
+    }
+}
+
 /* Fixed tasks command with better error handling */
 void cmd_tasks(int argc, char **argv) {
     if (n_proc > 0) {
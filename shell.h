@@ -7,6 +7,7 @@
 #define SHELL_BUFFER_SIZE 256
 #define MAX_ARGS 16
 #define MAX_ARG_LENGTH 64
+#define CAT_CHUNK 16384          /* bytes por lectura de 'cat' */
 
 /* Estructura de comando */
 struct command {
@@ -29,6 +30,8 @@ void cmd_echo(int argc, char **argv);
 void cmd_clear(int argc, char **argv);
 void cmd_create(int argc, char **argv);
 void cmd_delete(int argc, char **argv);
+void cmd_mkdir(int argc, char **argv);
+void cmd_compress(int argc, char **argv);
 void cmd_write(int argc, char **argv);
 void cmd_exec(int argc, char **argv);
 void cmd_ps(int argc, char **argv);
@@ -40,6 +43,13 @@ void cmd_leaks(int argc, char **argv);
 void cmd_defrag(int argc, char **argv);
 void cmd_heapmap(int argc, char **argv);
 void cmd_fsstat(int argc, char **argv);
+void cmd_cpuinfo(int argc, char **argv);
+void cmd_lspci(int argc, char **argv);
+void cmd_lsblk(int argc, char **argv);
+void cmd_blkbench(int argc, char **argv);
+void cmd_sync(int argc, char **argv);
+void cmd_iostat(int argc, char **argv);
+void cmd_stripe(int argc, char **argv);
 
 /* Variables globales */
 extern char shell_buffer[SHELL_BUFFER_SIZE];
@@ -0,0 +1,210 @@
+#include "stripe.h"
+#include "idt.h"
+#include "lib.h"
+#include "mm.h"
+#include "screen.h"
+
+/* Volúmenes creados */
+static struct stripe stripes[STRIPE_MAX_VOLUMES];
+static int stripe_count = 0;
+
+/* Termina un trozo; el último completa el comando del volumen */
+static void stripe_put(struct blk_request *rq, int status)
+{
+    struct stripe *st = (struct stripe *)rq->dev->priv;
+    struct stripe_rq *srq = &st->rqs[rq - rq->dev->rqs];
+    u32 flags;
+    int done;
+
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags) :: "memory");
+    if (status)
+        srq->status = -1;
+    done = (--srq->pending == 0);
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+
+    if (done)
+        blockdev_complete(rq, srq->status);
+}
+
+/* Callback de los trozos (bottom half de la IRQ del miembro) */
+static void stripe_end_io(struct bio *bio)
+{
+    stripe_put((struct blk_request *)bio->private, bio->status);
+}
+
+/*
+ * Operación submit: parte el comando en franjas (y en los cambios de
+ * segmento de memoria) y las envía como bio asíncronas a los miembros.
+ * Con las colas de los miembros retenidas, las franjas consecutivas de
+ * un mismo disco se fusionan en un solo comando.
+ */
+static int stripe_submit(struct blockdev *dev, struct blk_request *rq)
+{
+    struct stripe *st = (struct stripe *)dev->priv;
+    struct stripe_rq *srq = &st->rqs[rq - dev->rqs];
+    u32 lba = rq->lba;
+    u32 left = rq->count;
+    u8 *buf = (u8 *)rq->segs[0].buf;
+    u32 seg_left = rq->segs[0].count;
+    int seg = 0;
+    int i, n = 0;
+
+    while (left > 0) {
+        u32 stripe_no = lba / st->chunk;
+        u32 off = lba % st->chunk;
+        u32 c = st->chunk - off;
+        struct bio *child = &srq->children[n++];
+
+        if (c > seg_left)
+            c = seg_left;
+
+        child->dev = st->members[stripe_no % st->nmembers];
+        child->lba = (stripe_no / st->nmembers) * st->chunk + off;
+        child->count = c;
+        child->buf = buf;
+        child->write = rq->write;
+        child->private = rq;
+
+        lba += c;
+        buf += c * 512;
+        left -= c;
+        seg_left -= c;
+        if (seg_left == 0 && left > 0) {
+            seg++;
+            buf = (u8 *)rq->segs[seg].buf;
+            seg_left = rq->segs[seg].count;
+        }
+    }
+
+    // Referencia extra: un miembro síncrono no debe completarlo a medias
+    srq->status = 0;
+    srq->pending = n + 1;
+
+    for (i = 0; i < st->nmembers; i++)
+        blockdev_plug(st->members[i]);
+    for (i = 0; i < n; i++)
+        bio_submit(&srq->children[i], stripe_end_io);
+    for (i = 0; i < st->nmembers; i++)
+        blockdev_unplug(st->members[i]);
+
+    stripe_put(rq, 0);
+    return BLK_OK;
+}
+
+/* Operación poll: recoger en los miembros y ejecutar sus callbacks */
+static void stripe_poll(struct blockdev *dev)
+{
+    struct stripe *st = (struct stripe *)dev->priv;
+    int i;
+
+    for (i = 0; i < st->nmembers; i++) {
+        if (st->members[i]->poll)
+            st->members[i]->poll(st->members[i]);
+    }
+    bh_run();
+}
+
+/*
+ * Crea un volumen RAID-0 (md0, md1...) sobre 'n' dispositivos. Los
+ * miembros deberían estar en canales o controladores distintos para que
+ * trabajen a la vez. Devuelve el dispositivo o NULL si no es posible.
+ */
+struct blockdev *stripe_create(struct blockdev **members, int n, u32 chunk)
+{
+    struct stripe *st;
+    u32 per_member = 0xFFFFFFFF;
+    int i, j;
+
+    if (chunk == 0)
+        chunk = STRIPE_DEFAULT_CHUNK;
+
+    if (stripe_count >= STRIPE_MAX_VOLUMES) {
+        print("stripe : ERROR - too many volumes\n");
+        return NULL;
+    }
+    if (n < 2 || n > STRIPE_MAX_MEMBERS) {
+        print("stripe : ERROR - need 2 to 4 devices\n");
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < i; j++) {
+            if (members[j] == members[i]) {
+                print("stripe : ERROR - device used twice\n");
+                return NULL;
+            }
+        }
+        if (members[i]->submit == stripe_submit) {
+            print("stripe : ERROR - cannot stripe a stripe volume\n");
+            return NULL;
+        }
+        if (chunk > members[i]->max_sectors) {
+            print("stripe : ERROR - chunk larger than ");
+            print(members[i]->name);
+            print(" max I/O\n");
+            return NULL;
+        }
+        if (members[i]->sectors < per_member)
+            per_member = members[i]->sectors;
+    }
+    per_member -= per_member % chunk;
+    if (per_member == 0) {
+        print("stripe : ERROR - devices smaller than one chunk\n");
+        return NULL;
+    }
+
+    st = &stripes[stripe_count];
+    memset(st, 0, sizeof(struct stripe));
+    st->rqs = (struct stripe_rq *)kmalloc(STRIPE_INFLIGHT * sizeof(struct stripe_rq));
+    if (st->rqs == NULL) {
+        print("stripe : ERROR - cannot allocate request state\n");
+        return NULL;
+    }
+
+    st->nmembers = n;
+    st->chunk = chunk;
+    for (i = 0; i < n; i++) {
+        st->members[i] = members[i];
+        if (members[i]->polled)
+            st->blk.polled = 1;
+    }
+
+    memcpy(st->blk.name, "md0", 4);
+    st->blk.name[2] = '0' + stripe_count;
+    st->blk.sectors = per_member * n;
+    st->blk.submit = stripe_submit;
+    st->blk.poll = stripe_poll;
+    st->blk.max_sectors = chunk * STRIPE_RQ_CHUNKS;
+    st->blk.max_segs = BLK_MAX_SEGS;
+    st->blk.max_inflight = STRIPE_INFLIGHT;
+    st->blk.priv = st;
+
+    if (blockdev_register(&st->blk) < 0)
+        return NULL;
+    stripe_count++;
+
+    return &st->blk;
+}
+
+/* Composición de los volúmenes (comando 'stripe' sin argumentos) */
+void stripe_list(void)
+{
+    int i, j;
+
+    if (stripe_count == 0) {
+        print("No stripe volumes\n");
+        return;
+    }
+
+    for (i = 0; i < stripe_count; i++) {
+        print(stripes[i].blk.name);
+        print(": raid0, chunk ");
+        print_dec(stripes[i].chunk / 2);
+        print("KB,");
+        for (j = 0; j < stripes[i].nmembers; j++) {
+            print(" ");
+            print(stripes[i].members[j]->name);
+        }
+        print("\n");
+    }
+}
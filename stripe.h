@@ -0,0 +1,39 @@
+#ifndef STRIPE_H_
+#define STRIPE_H_
+
+#include "types.h"
+#include "blockdev.h"
+
+#define STRIPE_MAX_VOLUMES  2           /* md0, md1 */
+#define STRIPE_MAX_MEMBERS  4
+#define STRIPE_DEFAULT_CHUNK 128        /* sectores por franja (64KB) */
+#define STRIPE_RQ_CHUNKS    16          /* franjas por comando del volumen */
+#define STRIPE_INFLIGHT     4           /* comandos del volumen en vuelo */
+
+/* Trozos de un comando: uno por franja y por cambio de segmento */
+#define STRIPE_MAX_CHILDREN (STRIPE_RQ_CHUNKS + BLK_MAX_SEGS)
+
+/* Estado de un comando del volumen repartido entre los miembros */
+struct stripe_rq {
+    struct bio children[STRIPE_MAX_CHILDREN];
+    int pending;                        /* trozos sin terminar (+1 al enviar) */
+    int status;
+};
+
+/*
+ * Volumen RAID-0: el sector 'lba' está en la franja lba / chunk, que va
+ * al miembro (franja % n), en la posición (franja / n) * chunk de éste.
+ */
+struct stripe {
+    struct blockdev blk;
+    struct blockdev *members[STRIPE_MAX_MEMBERS];
+    int nmembers;
+    u32 chunk;                          /* sectores por franja */
+    struct stripe_rq *rqs;              /* en paralelo a blk.rqs */
+};
+
+/* Funciones */
+struct blockdev *stripe_create(struct blockdev **members, int n, u32 chunk);
+void stripe_list(void);
+
+#endif
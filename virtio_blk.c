@@ -0,0 +1,338 @@
+#include "virtio_blk.h"
+#include "pci.h"
+#include "idt.h"
+#include "io.h"
+#include "lib.h"
+#include "mm.h"
+#include "screen.h"
+
+// Dispositivos encontrados
+static struct virtio_blk *virtio_blks[VIRTIO_BLK_MAX_DEVICES];
+static int virtio_blk_count = 0;
+static u16 virtio_blk_irq_mask = 0;     // líneas IRQ ya instaladas
+
+#define barrier() asm volatile("" ::: "memory")
+
+// Tamaño de la virtqueue legacy: descriptores + avail, alineado, + used
+static u32 virtio_vring_size(u16 qsize) {
+    u32 first = 16 * qsize + 2 * (3 + qsize);
+    u32 second = 6 + 8 * qsize;
+
+    first = (first + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+    second = (second + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+    return first + second;
+}
+
+// Sacar un descriptor de la lista libre
+static u16 virtio_desc_alloc(struct virtio_blk *vb) {
+    u16 idx = vb->free_head;
+
+    vb->free_head = vb->desc[idx].next;
+    vb->num_free--;
+    return idx;
+}
+
+// Devolver a la lista libre la cadena que empieza en 'head'
+static void virtio_desc_free_chain(struct virtio_blk *vb, u16 head) {
+    u16 idx = head;
+
+    while (vb->desc[idx].flags & VRING_DESC_F_NEXT) {
+        vb->num_free++;
+        idx = vb->desc[idx].next;
+    }
+    vb->num_free++;
+
+    vb->desc[idx].next = vb->free_head;
+    vb->free_head = head;
+}
+
+/*
+ * Añadir una petición a la virtqueue sin avisar al dispositivo: cabecera,
+ * segmentos de datos y byte de estado encadenados. Las peticiones se
+ * publican en bloque con virtio_blk_kick(). Devuelve BLK_BUSY si no
+ * quedan descriptores libres y -1 si la petición no cabe nunca.
+ */
+int virtio_blk_submit(struct virtio_blk *vb, u32 lba, u32 count,
+                      struct blk_seg *sg, int nsg, int write,
+                      void (*done)(void *arg, int status), void *arg) {
+    struct virtio_blk_req *req;
+    u32 flags;
+    u32 needed = 2;
+    u16 head, idx, prev;
+    int i;
+
+    if (count == 0 || (write && vb->readonly)) return -1;
+
+    for (i = 0; i < nsg; i++) {
+        needed += (sg[i].count * 512 + vb->seg_bytes - 1) / vb->seg_bytes;
+    }
+    if (needed - 2 > vb->max_segs) return -1;
+
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags));
+
+    if (needed > vb->num_free) {
+        asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+        return BLK_BUSY;
+    }
+
+    head = virtio_desc_alloc(vb);
+    req = &vb->reqs[head];
+    req->hdr.type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    req->hdr.reserved = 0;
+    req->hdr.sector = lba;
+    req->status = 0xFF;
+    req->done = done;
+    req->arg = arg;
+
+    vb->desc[head].addr = (u32)&req->hdr;
+    vb->desc[head].len = sizeof(struct virtio_blk_req_hdr);
+    vb->desc[head].flags = VRING_DESC_F_NEXT;
+    prev = head;
+
+    for (i = 0; i < nsg; i++) {
+        u32 addr = (u32)sg[i].buf;
+        u32 left = sg[i].count * 512;
+
+        while (left > 0) {
+            u32 chunk = (left < vb->seg_bytes) ? left : vb->seg_bytes;
+
+            idx = virtio_desc_alloc(vb);
+            vb->desc[prev].next = idx;
+            vb->desc[idx].addr = addr;
+            vb->desc[idx].len = chunk;
+            vb->desc[idx].flags = VRING_DESC_F_NEXT | (write ? 0 : VRING_DESC_F_WRITE);
+
+            prev = idx;
+            addr += chunk;
+            left -= chunk;
+        }
+    }
+
+    idx = virtio_desc_alloc(vb);
+    vb->desc[prev].next = idx;
+    vb->desc[idx].addr = (u32)&req->status;
+    vb->desc[idx].len = 1;
+    vb->desc[idx].flags = VRING_DESC_F_WRITE;
+
+    vb->avail->ring[vb->avail_idx % vb->qsize] = head;
+    vb->avail_idx++;
+    vb->unkicked++;
+
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+    return 0;
+}
+
+// Publicar las peticiones añadidas y avisar al dispositivo una sola vez
+void virtio_blk_kick(struct virtio_blk *vb) {
+    u32 flags;
+
+    asm volatile("pushfl; popl %0; cli" : "=r" (flags));
+
+    barrier();
+    vb->avail->idx = vb->avail_idx;
+    barrier();
+
+    if (vb->unkicked && !(vb->used->flags & VRING_USED_F_NO_NOTIFY)) {
+        outw(vb->iobase + VIRTIO_REG_QUEUE_NOTIFY, 0);
+    }
+    vb->unkicked = 0;
+
+    asm volatile("pushl %0; popfl" :: "r" (flags) : "memory", "cc");
+}
+
+// Recoger las peticiones terminadas del anillo 'used'
+static void virtio_blk_complete(struct virtio_blk *vb) {
+    while (vb->last_used != vb->used->idx) {
+        volatile struct vring_used_elem *elem;
+        struct virtio_blk_req *req;
+        u16 head;
+
+        barrier();
+        elem = &vb->used->ring[vb->last_used % vb->qsize];
+        head = elem->id;
+        req = &vb->reqs[head];
+        vb->last_used++;
+
+        virtio_desc_free_chain(vb, head);
+        if (req->done) {
+            req->done(req->arg, req->status == VIRTIO_BLK_S_OK ? 0 : -1);
+        }
+    }
+}
+
+// Manejador de IRQ: leer ISR la reconoce y baja la línea
+void isr_virtio_blk_int(void) {
+    int i;
+
+    for (i = 0; i < virtio_blk_count; i++) {
+        if (inb(virtio_blks[i]->iobase + VIRTIO_REG_ISR) & 0x1) {
+            virtio_blk_complete(virtio_blks[i]);
+        }
+    }
+}
+
+static void virtio_blk_done(void *arg, int status) {
+    blockdev_complete((struct blk_request *)arg, status);
+}
+
+// Operaciones de la cola de bloques
+static int virtio_blk_blk_submit(struct blockdev *dev, struct blk_request *rq) {
+    return virtio_blk_submit((struct virtio_blk *)dev->priv, rq->lba, rq->count,
+                             rq->segs, rq->nseg, rq->write, virtio_blk_done, rq);
+}
+
+static void virtio_blk_blk_kick(struct blockdev *dev) {
+    virtio_blk_kick((struct virtio_blk *)dev->priv);
+}
+
+static void virtio_blk_blk_poll(struct blockdev *dev) {
+    virtio_blk_complete((struct virtio_blk *)dev->priv);
+}
+
+// Crear la virtqueue 0 con el tamaño que fija el dispositivo
+static int virtio_blk_setup_queue(struct virtio_blk *vb) {
+    u8 *mem;
+    u32 first;
+    u16 i;
+
+    outw(vb->iobase + VIRTIO_REG_QUEUE_SELECT, 0);
+    vb->qsize = inw(vb->iobase + VIRTIO_REG_QUEUE_SIZE);
+    if (vb->qsize == 0) return -1;
+
+    mem = (u8 *)kmalloc_aligned(virtio_vring_size(vb->qsize), VRING_ALIGN);
+    vb->reqs = (struct virtio_blk_req *)kmalloc_aligned(
+        vb->qsize * sizeof(struct virtio_blk_req), 4);
+    if (mem == NULL || vb->reqs == NULL) return -1;
+
+    memset(mem, 0, virtio_vring_size(vb->qsize));
+    memset(vb->reqs, 0, vb->qsize * sizeof(struct virtio_blk_req));
+
+    first = 16 * vb->qsize + 2 * (3 + vb->qsize);
+    first = (first + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+
+    vb->desc = (volatile struct vring_desc *)mem;
+    vb->avail = (volatile struct vring_avail *)(mem + 16 * vb->qsize);
+    vb->used = (volatile struct vring_used *)(mem + first);
+
+    for (i = 0; i < vb->qsize; i++) {
+        vb->desc[i].next = i + 1;
+    }
+    vb->free_head = 0;
+    vb->num_free = vb->qsize;
+    vb->avail_idx = 0;
+    vb->last_used = 0;
+    vb->unkicked = 0;
+
+    outl(vb->iobase + VIRTIO_REG_QUEUE_PFN, (u32)mem >> 12);
+    return 0;
+}
+
+// Probe de un dispositivo virtio-blk legacy
+static int virtio_blk_pci_probe(struct pci_device *dev) {
+    struct virtio_blk *vb;
+    u32 features, size_max, seg_max;
+    u16 cfg;
+
+    if (!dev->bar_is_io[0] || dev->bar[0] == 0) return -1;
+    if (virtio_blk_count >= VIRTIO_BLK_MAX_DEVICES) return -1;
+
+    vb = (struct virtio_blk *)kmalloc(sizeof(struct virtio_blk));
+    if (vb == NULL) return -1;
+    memset(vb, 0, sizeof(struct virtio_blk));
+
+    vb->iobase = dev->bar[0];
+    cfg = vb->iobase + VIRTIO_REG_CONFIG;
+
+    pci_enable_device(dev);
+    pci_enable_bus_master(dev);
+
+    // Reset y negociación de características
+    outb(vb->iobase + VIRTIO_REG_STATUS, 0);
+    outb(vb->iobase + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK);
+    outb(vb->iobase + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+    features = inl(vb->iobase + VIRTIO_REG_DEVICE_FEATURES);
+    features &= VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO;
+    outl(vb->iobase + VIRTIO_REG_GUEST_FEATURES, features);
+
+    vb->seg_bytes = VIRTIO_BLK_SEG_BYTES;
+    if (features & VIRTIO_BLK_F_SIZE_MAX) {
+        size_max = inl(cfg + VIRTIO_BLK_CFG_SIZE_MAX) & ~511;
+        if (size_max && size_max < vb->seg_bytes) vb->seg_bytes = size_max;
+    }
+    vb->max_segs = VIRTIO_BLK_MAX_DATA_DESC;
+    if (features & VIRTIO_BLK_F_SEG_MAX) {
+        seg_max = inl(cfg + VIRTIO_BLK_CFG_SEG_MAX);
+        if (seg_max && seg_max < vb->max_segs) vb->max_segs = seg_max;
+    }
+    vb->readonly = (features & VIRTIO_BLK_F_RO) != 0;
+
+    // Capacidad (u64); el resto del kernel direcciona con 32 bits
+    vb->sectors = inl(cfg + VIRTIO_BLK_CFG_CAPACITY);
+    if (inl(cfg + VIRTIO_BLK_CFG_CAPACITY + 4)) vb->sectors = 0xFFFFFFFF;
+
+    if (virtio_blk_setup_queue(vb)) {
+        print("virtio : ERROR - Cannot set up virtqueue\n");
+        outb(vb->iobase + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+        return -1;
+    }
+
+    outb(vb->iobase + VIRTIO_REG_STATUS,
+         VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    // Nombres vda, vdb, ...
+    memcpy(vb->blk.name, "vda", 4);
+    vb->blk.name[2] = 'a' + virtio_blk_count;
+    vb->blk.sectors = vb->sectors;
+    vb->blk.submit = virtio_blk_blk_submit;
+    vb->blk.kick = virtio_blk_blk_kick;
+    vb->blk.poll = virtio_blk_blk_poll;
+
+    /*
+     * Un segmento de la cola puede necesitar un descriptor más de los que
+     * da su tamaño (si no empieza alineado), así que se reserva la mitad.
+     */
+    vb->blk.max_segs = vb->max_segs > 1 ? vb->max_segs / 2 : 1;
+    vb->blk.max_sectors = (vb->seg_bytes / 512) * vb->blk.max_segs;
+    vb->blk.max_inflight = vb->qsize / 3;
+    vb->blk.priv = vb;
+
+    virtio_blks[virtio_blk_count++] = vb;
+
+    print("virtio : ");
+    print(vb->blk.name);
+    print(": queue size ");
+    print_dec(vb->qsize);
+    if (vb->readonly) print(", read-only");
+
+    if (dev->irq_pin && dev->irq_line < 16) {
+        if (!(virtio_blk_irq_mask & (1 << dev->irq_line)) &&
+            irq_install_handler(dev->irq_line, isr_virtio_blk_int) == 0) {
+            virtio_blk_irq_mask |= 1 << dev->irq_line;
+        }
+    }
+    if (virtio_blk_irq_mask & (1 << dev->irq_line)) {
+        print(", IRQ ");
+        print_dec(dev->irq_line);
+    } else {
+        print(", polling");
+        vb->blk.polled = 1;
+    }
+    print("\n");
+
+    blockdev_register(&vb->blk);
+    return 0;
+}
+
+static struct pci_driver virtio_blk_pci_driver = {
+    "virtio-blk", VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, PCI_ANY_CLASS, 0,
+    virtio_blk_pci_probe
+};
+
+// Inicialización: registra el driver PCI
+void virtio_blk_init(void) {
+    memset(virtio_blks, 0, sizeof(virtio_blks));
+    virtio_blk_count = 0;
+
+    pci_register_driver(&virtio_blk_pci_driver);
+}
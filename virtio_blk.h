@@ -0,0 +1,122 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "types.h"
+#include "blockdev.h"
+
+// Dispositivo PCI (virtio legacy/transitional)
+#define VIRTIO_VENDOR_ID        0x1AF4
+#define VIRTIO_BLK_DEVICE_ID    0x1001
+
+// Registros de la cabecera legacy (BAR0, espacio de I/O)
+#define VIRTIO_REG_DEVICE_FEATURES  0x00
+#define VIRTIO_REG_GUEST_FEATURES   0x04
+#define VIRTIO_REG_QUEUE_PFN        0x08
+#define VIRTIO_REG_QUEUE_SIZE       0x0C
+#define VIRTIO_REG_QUEUE_SELECT     0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY     0x10
+#define VIRTIO_REG_STATUS           0x12
+#define VIRTIO_REG_ISR              0x13
+#define VIRTIO_REG_CONFIG           0x14    // sin MSI-X
+
+// Configuración de virtio-blk (desplazamientos desde VIRTIO_REG_CONFIG)
+#define VIRTIO_BLK_CFG_CAPACITY     0x00    // u64, sectores de 512 bytes
+#define VIRTIO_BLK_CFG_SIZE_MAX     0x08
+#define VIRTIO_BLK_CFG_SEG_MAX      0x0C
+
+// Estado del dispositivo
+#define VIRTIO_STATUS_ACK           0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FAILED        0x80
+
+// Características de virtio-blk que usamos
+#define VIRTIO_BLK_F_SIZE_MAX       0x00000002
+#define VIRTIO_BLK_F_SEG_MAX        0x00000004
+#define VIRTIO_BLK_F_RO             0x00000020
+
+// Tipos de petición y estados
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_S_OK             0
+#define VRING_USED_F_NO_NOTIFY      1
+
+// Descriptores
+#define VRING_DESC_F_NEXT           1
+#define VRING_DESC_F_WRITE          2       // el dispositivo escribe
+#define VRING_ALIGN                 4096
+
+// Límites del driver
+#define VIRTIO_BLK_MAX_DEVICES      4
+#define VIRTIO_BLK_SEG_BYTES        0x10000 // bytes por descriptor de datos
+#define VIRTIO_BLK_MAX_DATA_DESC    16
+
+// Virtqueue partida (formato legacy)
+struct vring_desc {
+    u64 addr;
+    u32 len;
+    u16 flags;
+    u16 next;
+} __attribute__((packed));
+
+struct vring_avail {
+    u16 flags;
+    u16 idx;
+    u16 ring[];
+} __attribute__((packed));
+
+struct vring_used_elem {
+    u32 id;
+    u32 len;
+} __attribute__((packed));
+
+struct vring_used {
+    u16 flags;
+    u16 idx;
+    struct vring_used_elem ring[];
+} __attribute__((packed));
+
+// Cabecera de una petición de bloque
+struct virtio_blk_req_hdr {
+    u32 type;
+    u32 reserved;
+    u64 sector;
+} __attribute__((packed));
+
+// Petición en vuelo, indexada por su descriptor de cabeza
+struct virtio_blk_req {
+    struct virtio_blk_req_hdr hdr;
+    volatile u8 status;
+    void (*done)(void *arg, int status);
+    void *arg;
+};
+
+// Estado de un dispositivo virtio-blk
+struct virtio_blk {
+    u16 iobase;
+    u16 qsize;
+    volatile struct vring_desc *desc;
+    volatile struct vring_avail *avail;
+    volatile struct vring_used *used;
+    struct virtio_blk_req *reqs;
+    u16 free_head;      // lista de descriptores libres
+    u16 num_free;
+    u16 avail_idx;      // copia local: se publica en virtio_blk_kick()
+    u16 last_used;
+    u16 unkicked;       // peticiones añadidas desde el último aviso
+    u32 seg_bytes;      // bytes máximos por descriptor de datos
+    u16 max_segs;       // descriptores de datos por petición
+    u32 sectors;
+    u8 readonly;
+    struct blockdev blk;
+};
+
+// Funciones
+void virtio_blk_init(void);
+int virtio_blk_submit(struct virtio_blk *vb, u32 lba, u32 count,
+                      struct blk_seg *sg, int nsg, int write,
+                      void (*done)(void *arg, int status), void *arg);
+void virtio_blk_kick(struct virtio_blk *vb);
+void isr_virtio_blk_int(void);
+
+#endif